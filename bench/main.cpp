@@ -0,0 +1,401 @@
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "apu.hxx"
+#include "batch_cpu.hxx"
+#include "bus.hxx"
+#include "cartridge.hxx"
+#include "constants.hxx"
+#include "controller.hxx"
+#include "coroutine_cpu.hxx"
+#include "cpu.hxx"
+#include "declarative_mapper.hxx"
+#include "interrupts.hxx"
+#include "ppu.hxx"
+#include "sen.hxx"
+#include "util.hxx"
+
+// Headless throughput benchmarks. Usage: sen_bench <rom> [frames] [lanes]
+// Frames are counted per instance, so engines running several instances at once report
+// instances x frames per second
+
+class NullAudioQueue final : public AudioQueue {
+  public:
+    void push(float) override {}
+};
+
+struct BenchResult {
+    double seconds;
+    uint64_t frames; // Summed over all instances
+};
+
+static std::shared_ptr<Bus> MakeBus(const RomArgs& rom_args, InterruptLines* interrupts) {
+    auto cartridge = ParseRomFile(rom_args);
+    auto ppu = std::make_shared<Ppu>(cartridge, interrupts);
+    auto apu = std::make_shared<Apu>(std::make_shared<NullAudioQueue>(), interrupts);
+    return std::make_shared<Bus>(
+        std::move(cartridge),
+        std::move(ppu),
+        std::move(apu),
+        std::make_shared<Controller>()
+    );
+}
+
+// Runs the whole system with `CoroutineCpu` driving the bus instead of `Cpu`
+class CoroutineSystem {
+  private:
+    InterruptLines interrupts{};
+    std::shared_ptr<Bus> bus;
+    CoroutineCpu<Bus> cpu;
+    uint64_t carry_over_cycles{};
+
+  public:
+    explicit CoroutineSystem(const RomArgs& rom_args) :
+        bus{MakeBus(rom_args, &interrupts)},
+        cpu{bus, &interrupts} {
+        cpu.start();
+    }
+
+    void RunForOneFrame() {
+        const auto target_cycles = bus->cycles + CYCLES_PER_FRAME - carry_over_cycles;
+        while (bus->cycles < target_cycles) {
+            cpu.tick();
+        }
+        carry_over_cycles = bus->cycles - target_cycles;
+    }
+};
+
+// The PPU on its own drawing a busy screen with the given PPUCTRL and PPUMASK, to time the render
+// kernels for each configuration without the CPU in the way
+class PpuOnlySystem {
+  private:
+    InterruptLines interrupts{};
+    Ppu ppu;
+    uint64_t dots{};
+
+  public:
+    PpuOnlySystem(const RomArgs& rom_args, const byte ppuctrl, const byte ppumask) :
+        ppu{ParseRomFile(rom_args), &interrupts} {
+        ppu.CpuWrite(0x2006, 0x20);
+        ppu.CpuWrite(0x2006, 0x00);
+        for (unsigned int i = 0; i < 0x400; i++) {
+            ppu.CpuWrite(0x2007, static_cast<byte>(i * 7));
+        }
+
+        // All 64 sprites, eight to a band of lines so every line has a full set
+        ppu.CpuWrite(0x2003, 0x00);
+        for (unsigned int i = 0; i < 64; i++) {
+            ppu.CpuWrite(0x2004, static_cast<byte>((i / 8) * 28 + 8));
+            ppu.CpuWrite(0x2004, static_cast<byte>(i * 5));
+            ppu.CpuWrite(0x2004, static_cast<byte>(i & 0x23));
+            ppu.CpuWrite(0x2004, static_cast<byte>((i % 8) * 30 + 4));
+        }
+
+        ppu.CpuWrite(0x2000, ppuctrl);
+        ppu.CpuWrite(0x2001, ppumask);
+    }
+
+    void RunForOneFrame() {
+        const auto frame = ppu.frame_count;
+        while (ppu.frame_count == frame) {
+            ppu.Tick(dots++ / 3);
+        }
+    }
+};
+
+// UxROM, CNROM and AxROM written out by hand, to compare generated mappers with hand-written ones
+// switching PRG banks, CHR banks and the mirroring the same way
+class HandWrittenUxrom final: public Cartridge {
+  public:
+    explicit HandWrittenUxrom(std::shared_ptr<const RomImage> image) :
+        Cartridge(std::move(image)) {
+        map_prg(0xC000, 0x4000, prg_rom.size() - 0x4000);
+    }
+
+  private:
+    void register_write(const uint64_t cpu_cycle, const word address, const byte data) override {
+        map_prg(0x8000, 0x4000, (data & cpu_read(cpu_cycle, address) & 0x0FU) * 0x4000);
+    }
+};
+
+class HandWrittenCnrom final: public Cartridge {
+  public:
+    explicit HandWrittenCnrom(std::shared_ptr<const RomImage> image) :
+        Cartridge(std::move(image)) {}
+
+  private:
+    void register_write(const uint64_t cpu_cycle, const word address, const byte data) override {
+        map_chr(0x0000, 0x2000, (data & cpu_read(cpu_cycle, address) & 0x03U) * 0x2000);
+    }
+};
+
+class HandWrittenAxrom final: public Cartridge {
+  public:
+    explicit HandWrittenAxrom(std::shared_ptr<const RomImage> image) :
+        Cartridge(std::move(image)) {}
+
+    [[nodiscard]] Mirroring mirroring() const override {
+        return (bank & 0x10U) != 0 ? Mirroring::SingleScreenUpper : Mirroring::SingleScreenLower;
+    }
+
+  private:
+    byte bank{};
+
+    void register_write(uint64_t, word, const byte data) override {
+        const auto previous_mirroring = mirroring();
+        bank = data;
+        map_prg(0x8000, 0x8000, (bank & 0x07U) * 0x8000);
+        if (mirroring() != previous_mirroring) {
+            mirroring_generation++;
+        }
+    }
+};
+
+template<typename RunFrame>
+static BenchResult
+TimeFrames(const unsigned int frames, const size_t instances, RunFrame&& run_frame) {
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < frames; i++) {
+        run_frame();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    return {
+        .seconds = std::chrono::duration<double>(end - start).count(),
+        .frames = frames * instances,
+    };
+}
+
+// Keeps the reads below from being optimised away
+static volatile uint64_t read_checksum;
+
+// A frame's worth of code fetches from PRG-ROM, one per CPU cycle, either decoded by the bus or
+// straight out of the PRG windows like `Cpu::code_read()` does
+template<bool ThroughWindows>
+static BenchResult TimeCodeFetch(const RomArgs& rom_args, const unsigned int frames) {
+    InterruptLines interrupts{};
+    const auto bus = MakeBus(rom_args, &interrupts);
+    Cpu<Bus> cpu{bus, &interrupts};
+
+    uint64_t checksum{};
+    word address = PRG_ROM_START;
+    const auto result = TimeFrames(frames, 1, [&] {
+        for (uint64_t cycle = 0; cycle < CYCLES_PER_FRAME; cycle++) {
+            checksum += ThroughWindows ? cpu.code_read(address) : bus->cpu_read(address);
+            address = PRG_ROM_START | (address + 0x1F3U);
+        }
+    });
+
+    read_checksum = checksum;
+    return result;
+}
+
+// A frame's worth of PRG and CHR reads, one each per CPU cycle, switching banks every 256 cycles
+// the way a game streaming level data would
+template<typename Mapper>
+static BenchResult TimeMapper(const unsigned int frames) {
+    constexpr size_t PRG_SIZE = 0x20000;
+    constexpr size_t CHR_SIZE = 0x8000;
+    const RomHeader header{
+        .prg_rom_size = PRG_SIZE,
+        .prg_rom_banks = PRG_SIZE / 0x4000,
+        .chr_rom_size = CHR_SIZE,
+        .chr_rom_banks = CHR_SIZE / 0x2000,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Vertical,
+        .mapper_number = 0,
+    };
+    Mapper cartridge{std::make_shared<const RomImage>(
+        header,
+        std::vector<byte>(PRG_SIZE, 0xFF),
+        std::vector<byte>(CHR_SIZE, 0xFF)
+    )};
+
+    uint64_t checksum{};
+    word address = 0x8000;
+    const auto result = TimeFrames(frames, 1, [&] {
+        for (uint64_t cycle = 0; cycle < CYCLES_PER_FRAME; cycle++) {
+            if ((cycle & 0xFFU) == 0) {
+                cartridge.cpu_write(cycle, 0x8000, static_cast<byte>(cycle >> 8U));
+                checksum += cartridge.nametable_generation();
+            }
+            checksum += cartridge.cpu_read(cycle, address);
+            checksum += cartridge.ppu_read(address & 0x1FFFU);
+            address = 0x8000U | (address + 0x1F3U);
+        }
+    });
+
+    read_checksum = checksum;
+    return result;
+}
+
+static void Report(const std::string& name, const BenchResult& result) {
+    const auto cycles = static_cast<double>(result.frames * CYCLES_PER_FRAME);
+    fmt::print(
+        "{:<24} {:>10.1f} frames/s {:>8.2f} ns/cycle\n",
+        name,
+        static_cast<double>(result.frames) / result.seconds,
+        result.seconds * 1e9 / cycles
+    );
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fmt::print(stderr, "Usage: {} <rom> [frames] [lanes]\n", argv[0]);
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+
+    const RomArgs rom_args{ReadBinaryFile(argv[1])};
+    const unsigned int frames = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 600;
+    const size_t lanes = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 64;
+    const size_t output_threads = std::max(3U, std::thread::hardware_concurrency()) - 1;
+
+    // What an agent typically takes after every frame: 84x84 grayscale, RAM and the tile map
+    constexpr size_t OBSERVATION_SIZE = 84;
+    std::vector<byte> luma(OBSERVATION_SIZE * OBSERVATION_SIZE);
+    std::array<byte, IWRAM_SIZE> ram{};
+    std::array<byte, NAMETABLE_TILES> tiles{};
+    const auto observe = [&](const Sen& sen) {
+        sen.ObserveLuma(luma, OBSERVATION_SIZE, OBSERVATION_SIZE);
+        sen.ObserveRam(ram);
+        sen.ObserveNametable(tiles);
+    };
+    const auto observe_lanes = [&](const BatchCpu& cpu) {
+        for (size_t lane = 0; lane < cpu.lanes(); lane++) {
+            cpu.observe_luma(lane, luma, OBSERVATION_SIZE, OBSERVATION_SIZE);
+            cpu.observe_ram(lane, ram);
+            cpu.observe_nametable(lane, tiles);
+        }
+    };
+
+    struct Benchmark {
+        std::string name;
+        std::function<BenchResult()> run;
+    };
+
+    const std::vector<Benchmark> benchmarks{
+        {"cpu",
+         [&] {
+             Sen sen{rom_args, std::make_shared<NullAudioQueue>()};
+             return TimeFrames(frames, 1, [&] { sen.RunForOneFrame(); });
+         }},
+        {"cpu no-output",
+         [&] {
+             Sen sen{rom_args, std::make_shared<NullAudioQueue>()};
+             return TimeFrames(frames, 1, [&] { sen.RunForOneFrame(false); });
+         }},
+        {"cpu output-threads x1",
+         [&] {
+             Sen sen{rom_args, std::make_shared<NullAudioQueue>()};
+             sen.SetOutputThreads(1);
+             return TimeFrames(frames, 1, [&] { sen.RunForOneFrame(); });
+         }},
+        {fmt::format("cpu output-threads x{}", output_threads),
+         [&] {
+             Sen sen{rom_args, std::make_shared<NullAudioQueue>()};
+             sen.SetOutputThreads(output_threads);
+             return TimeFrames(frames, 1, [&] { sen.RunForOneFrame(); });
+         }},
+        {"cpu + observations",
+         [&] {
+             Sen sen{rom_args, std::make_shared<NullAudioQueue>()};
+             return TimeFrames(frames, 1, [&] {
+                 sen.RunForOneFrame();
+                 observe(sen);
+             });
+         }},
+        {"ppu bg+sprites",
+         [&] {
+             PpuOnlySystem system{rom_args, 0x00, 0x1E};
+             return TimeFrames(frames, 1, [&] { system.RunForOneFrame(); });
+         }},
+        {"ppu bg+sprites clipped",
+         [&] {
+             PpuOnlySystem system{rom_args, 0x00, 0x18};
+             return TimeFrames(frames, 1, [&] { system.RunForOneFrame(); });
+         }},
+        {"ppu bg-only",
+         [&] {
+             PpuOnlySystem system{rom_args, 0x00, 0x0A};
+             return TimeFrames(frames, 1, [&] { system.RunForOneFrame(); });
+         }},
+        {"ppu 8x16 sprites",
+         [&] {
+             PpuOnlySystem system{rom_args, 0x20, 0x1E};
+             return TimeFrames(frames, 1, [&] { system.RunForOneFrame(); });
+         }},
+        {"coroutine-cpu",
+         [&] {
+             CoroutineSystem system{rom_args};
+             return TimeFrames(frames, 1, [&] { system.RunForOneFrame(); });
+         }},
+        {"code fetch bus", [&] { return TimeCodeFetch<false>(rom_args, frames * 10); }},
+        {"code fetch windows", [&] { return TimeCodeFetch<true>(rom_args, frames * 10); }},
+        {"mapper uxrom", [&] { return TimeMapper<HandWrittenUxrom>(frames * 10); }},
+        {"mapper uxrom generated", [&] { return TimeMapper<Uxrom>(frames * 10); }},
+        {"mapper cnrom", [&] { return TimeMapper<HandWrittenCnrom>(frames * 10); }},
+        {"mapper cnrom generated", [&] { return TimeMapper<Cnrom>(frames * 10); }},
+        {"mapper axrom", [&] { return TimeMapper<HandWrittenAxrom>(frames * 10); }},
+        {"mapper axrom generated", [&] { return TimeMapper<Axrom>(frames * 10); }},
+        {fmt::format("batch-cpu x{}", lanes),
+         [&] {
+             BatchCpu cpu{rom_args, lanes};
+             return TimeFrames(frames, lanes, [&] { cpu.run_for_one_frame(); });
+         }},
+        {fmt::format("batch-cpu x{} + obs", lanes),
+         [&] {
+             BatchCpu cpu{rom_args, lanes};
+             return TimeFrames(frames, lanes, [&] {
+                 cpu.run_for_one_frame();
+                 observe_lanes(cpu);
+             });
+         }},
+        {fmt::format("batch-cpu x{} scalar", lanes),
+         [&] {
+             BatchCpu cpu{rom_args, lanes};
+             cpu.set_lockstep(false);
+             return TimeFrames(frames, lanes, [&] { cpu.run_for_one_frame(); });
+         }},
+    };
+
+    for (const auto& [name, run] : benchmarks) {
+        Report(name, run());
+    }
+
+    // Observations alone, taken over and over from the same frame
+    Sen sen{rom_args, std::make_shared<NullAudioQueue>()};
+    sen.RunForOneFrame();
+    const auto observations = TimeFrames(frames * 10, 1, [&] { observe(sen); });
+    fmt::print(
+        "{:<24} {:>10.1f} observations/s\n",
+        "observations",
+        static_cast<double>(observations.frames) / observations.seconds
+    );
+
+    // What running `lanes` instances of the ROM side by side costs, all of them sharing its image
+    const auto footprint = sen.Footprint();
+    fmt::print(
+        "{:<24} {:>10} KB shared {:>8} KB/instance {:>8} KB for x{}\n",
+        "memory",
+        footprint.shared / 1024,
+        footprint.instance / 1024,
+        (footprint.shared + lanes * footprint.instance) / 1024,
+        lanes
+    );
+
+    return 0;
+}
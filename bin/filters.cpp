@@ -7,23 +7,33 @@
 #include <algorithm>
 #include <ranges>
 
-PostProcessedData NoFilter::PostProcess(const std::span<unsigned short, 61440> nes_pixels, int) {
-    if (pixels.size() != NES_WIDTH * NES_HEIGHT) {
-        pixels.resize(NES_WIDTH * NES_HEIGHT);
-    }
-
+PostProcessedData NoFilter::PostProcess(
+    const PpuFramebuffer& framebuffer,
+    const std::bitset<NES_HEIGHT>& dirty_lines,
+    int
+) {
+    const auto lines = LinesToUpdate(dirty_lines);
     for (int y = 0; y < NES_HEIGHT; y++) {
+        if (!lines[y]) {
+            continue;
+        }
+        const auto line = framebuffer.Line(y);
         for (int x = 0; x < NES_WIDTH; x++) {
-            const byte color_index = nes_pixels[y * NES_WIDTH + x];
-            pixels[y * NES_WIDTH + x] = PALETTE_COLORS[color_index];
+            pixels[y * NES_WIDTH + x] = PALETTE_COLORS[line[x]];
         }
     }
 
-    return {.data = pixels.data(), .width = NES_WIDTH, .height = NES_HEIGHT};
+    return {
+        .data = pixels.data(),
+        .width = NES_WIDTH,
+        .height = NES_HEIGHT,
+        .changed = lines.any()
+    };
 }
 
 PostProcessedData NtscFilter::PostProcess(
-    const std::span<unsigned short, 61440> nes_pixels,
+    const PpuFramebuffer& framebuffer,
+    const std::bitset<NES_HEIGHT>& dirty_lines,
     int current_scale_factor
 ) {
     if (current_scale_factor != scale_factor) {
@@ -38,6 +48,19 @@ PostProcessedData NtscFilter::PostProcess(
         );
     }
 
+    const auto lines = LinesToUpdate(dirty_lines);
+    for (int y = 0; y < NES_HEIGHT; y++) {
+        if (!lines[y]) {
+            continue;
+        }
+        const auto line = framebuffer.Line(y);
+        const unsigned short emphasis = framebuffer.emphasis[y] << 6;
+        for (int x = 0; x < NES_WIDTH; x++) {
+            nes_pixels[y * NES_WIDTH + x] = emphasis | line[x];
+        }
+    }
+
+    // The signal is noisy so the picture changes every frame either way
     ntsc.data = nes_pixels.data();
     ntsc.w = NES_WIDTH;
     ntsc.h = NES_HEIGHT;
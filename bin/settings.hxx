@@ -23,7 +23,7 @@ enum class UiStyle : uint8_t {
     SuperDark = 3,
 };
 
-constexpr int NUM_PANELS = 9;
+constexpr int NUM_PANELS = 10;
 enum class UiPanel : uint8_t {
     Registers = 0,
     PatternTables = 1,
@@ -34,6 +34,7 @@ enum class UiPanel : uint8_t {
     Debugger = 6,
     Logs = 7,
     VolumeControl = 8,
+    EventViewer = 9,
 };
 
 enum class FilterType : uint8_t {
@@ -77,6 +78,13 @@ struct SenSettings {
             ui_settings.add("filter", libconfig::Setting::TypeInt) =
                 static_cast<int>(FilterType::NoFilter);
         }
+        if (!ui_settings.exists("idle_loop_skipping")) {
+            ui_settings.add("idle_loop_skipping", libconfig::Setting::TypeBoolean) = false;
+        }
+        if (!ui_settings.exists("output_threads")) {
+            // Off, drawing threads only help with cores to spare
+            ui_settings.add("output_threads", libconfig::Setting::TypeInt) = 0;
+        }
         if (!ui_settings.exists("open_panels")) {
             ui_settings.add("open_panels", libconfig::Setting::TypeInt) = 0;
         } else {
@@ -146,6 +154,22 @@ struct SenSettings {
         cfg.getRoot()["ui"]["style"] = static_cast<int>(style);
     }
 
+    [[nodiscard]] bool IdleLoopSkipping() const {
+        return cfg.getRoot()["ui"]["idle_loop_skipping"];
+    }
+
+    void SetIdleLoopSkipping(const bool enabled) const {
+        cfg.getRoot()["ui"]["idle_loop_skipping"] = enabled;
+    }
+
+    [[nodiscard]] int OutputThreads() const {
+        return cfg.getRoot()["ui"]["output_threads"];
+    }
+
+    void SetOutputThreads(const int threads) const {
+        cfg.getRoot()["ui"]["output_threads"] = threads;
+    }
+
     [[nodiscard]] std::array<bool, NUM_PANELS>& GetOpenPanels() {
         return open_panels;
     }
@@ -14,9 +14,12 @@
 
 #include <algorithm>
 #include <bitset>
+#include <cstdlib>
 #include <memory>
 #include <ranges>
 #include <span>
+#include <string>
+#include <thread>
 
 #include "controller.hxx"
 #include "fa.h"
@@ -354,15 +357,8 @@ void Ui::run() {
         handle_sdl_events();
 
         if (emulation_running) {
-            // Run emulator for `dt` equivalent cycles and check if frame passed
-            const auto initial_frame_count = emulator_context->FrameCount();
+            // Run emulator for `dt` equivalent cycles
             emulator_context->RunForCycles(cpu_cycles_to_run);
-            if (emulator_context->FrameCount() != initial_frame_count && audio_frame_delay != 0) {
-                audio_frame_delay--;
-                if (audio_frame_delay == 0) {
-                    audio_queue->resume();
-                }
-            }
         }
 
         render_ui();
@@ -423,11 +419,27 @@ void Ui::render_ui() {
             ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoTitleBar
         );
 
-        const auto framebuffer = debugger.Framebuffer();
-        const auto [data, width, height] = filter->PostProcess(framebuffer, settings.ScaleFactor());
+        auto& framebuffer = debugger.Framebuffer();
+        const auto [data, width, height, changed] = filter->PostProcess(
+            framebuffer,
+            framebuffer.TakeDirtyLines(),
+            settings.ScaleFactor()
+        );
 
         glBindTexture(GL_TEXTURE_2D, game_texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+        if (changed) {
+            glTexImage2D(
+                GL_TEXTURE_2D,
+                0,
+                GL_RGB,
+                width,
+                height,
+                0,
+                GL_RGB,
+                GL_UNSIGNED_BYTE,
+                data
+            );
+        }
         ImGui::Image(
             game_texture,
             ImVec2(NES_WIDTH * settings.ScaleFactor(), NES_HEIGHT * settings.ScaleFactor())
@@ -442,6 +454,7 @@ void Ui::render_ui() {
         show_oam();
         show_opcodes();
         show_debugger();
+        show_event_viewer();
     }
 
     show_logs();
@@ -536,11 +549,44 @@ void Ui::show_menu_bar() {
             if (ImGui::MenuItem("Stop", nullptr, false, emulation_running)) {
                 stop_emulation();
             }
+            ImGui::Separator();
+            if (ImGui::MenuItem("Skip Idle Loops", nullptr, settings.IdleLoopSkipping())) {
+                settings.SetIdleLoopSkipping(!settings.IdleLoopSkipping());
+                if (emulator_context != nullptr) {
+                    emulator_context->SetIdleLoopSkipping(settings.IdleLoopSkipping());
+                }
+            }
+            if (ImGui::BeginMenu("Drawing Threads")) {
+                // Leave one core to the emulation itself, drawing threads sharing its core only
+                // slow it down
+                const int max_threads =
+                    std::max(0, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+                for (int threads = 0; threads <= max_threads; threads++) {
+                    const auto label = threads == 0 ? std::string{"Off"} : std::to_string(threads);
+                    if (ImGui::MenuItem(
+                            label.c_str(),
+                            nullptr,
+                            settings.OutputThreads() == threads
+                        )) {
+                        settings.SetOutputThreads(threads);
+                        if (emulator_context != nullptr) {
+                            emulator_context->SetOutputThreads(threads);
+                        }
+                    }
+                }
+                ImGui::EndMenu();
+            }
             ImGui::EndMenu();
         }
 
         if (ImGui::BeginMenu("View")) {
             ImGui::Text("Framerate: %.2f", ImGui::GetIO().Framerate);
+            if (emulator_context != nullptr && emulator_context->IdleLoopSkipping()) {
+                ImGui::Text(
+                    "Idle loop cycles fast-forwarded: %lu",
+                    static_cast<unsigned long>(emulator_context->IdleCyclesFastForwardedLastFrame())
+                );
+            }
             if (ImGui::BeginMenu("Scale")) {
                 for (int i = 1; i <= 5; i++) {
                     if (ImGui::MenuItem(
@@ -651,6 +697,14 @@ void Ui::show_menu_bar() {
                 )) {
                 settings.TogglePanel(UiPanel::Sprites);
             }
+            if (ImGui::MenuItem(
+                    "Event Viewer",
+                    nullptr,
+                    open_panels[static_cast<int>(UiPanel::EventViewer)],
+                    emulation_running
+                )) {
+                settings.TogglePanel(UiPanel::EventViewer);
+            }
             if (ImGui::MenuItem(
                     "Volume",
                     nullptr,
@@ -1170,6 +1224,110 @@ void Ui::show_logs() {
     sink->render_window(&open_panels[static_cast<int>(UiPanel::Logs)], 0);
 }
 
+struct PpuEventStyle {
+    const char* name;
+    ImU32 color;
+};
+
+// Indexed by `PpuEventType`
+static constexpr std::array<PpuEventStyle, 5> PPU_EVENT_STYLES{{
+    {"Register reads", IM_COL32(80, 200, 120, 255)},
+    {"Register writes", IM_COL32(240, 200, 60, 255)},
+    {"Mapper writes", IM_COL32(80, 160, 255, 255)},
+    {"NMI", IM_COL32(255, 70, 70, 255)},
+    {"IRQ", IM_COL32(230, 100, 255, 255)},
+}};
+
+void Ui::show_event_viewer() {
+    auto& open_panels = settings.GetOpenPanels();
+    if (!open_panels[static_cast<int>(UiPanel::EventViewer)]) {
+        // Only record while someone is looking, the buffers are freed once the panel is closed
+        emulator_context->SetEventLogging(false);
+        return;
+    }
+
+    if (ImGui::Begin("Event Viewer", &open_panels[static_cast<int>(UiPanel::EventViewer)])) {
+        // Unticking only pauses the log, so the last frame recorded stays on screen
+        static bool recording = true;
+        ImGui::Checkbox("Record", &recording);
+        emulator_context->SetEventLogging(true);
+        emulator_context->SetEventLogPaused(!recording);
+
+        static std::array<bool, PPU_EVENT_STYLES.size()> shown = [] {
+            std::array<bool, PPU_EVENT_STYLES.size()> types{};
+            types.fill(true);
+            return types;
+        }();
+        for (size_t i = 0; i < PPU_EVENT_STYLES.size(); i++) {
+            ImGui::SameLine();
+            ImGui::PushStyleColor(ImGuiCol_CheckMark, PPU_EVENT_STYLES[i].color);
+            ImGui::Checkbox(PPU_EVENT_STYLES[i].name, &shown[i]);
+            ImGui::PopStyleColor();
+        }
+
+        const auto* log = emulator_context->EventLog();
+        const auto events = log ? log->LastFrame() : std::span<const PpuEvent>{};
+        ImGui::Text(
+            "%zu events, %zu dropped",
+            events.size(),
+            log ? log->LastFrameDropped() : size_t{0}
+        );
+
+        // One cell per dot of every scanline, with the visible picture and VBlank shaded
+        constexpr float CELL = 2.0F;
+        constexpr unsigned int DOTS = 341;
+        constexpr unsigned int SCANLINES = 262;
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        const auto cell = [&](const float dot, const float scanline) {
+            return ImVec2(origin.x + dot * CELL, origin.y + scanline * CELL);
+        };
+
+        ImDrawList* draw_list = ImGui::GetWindowDrawList();
+        draw_list->AddRectFilled(cell(0, 0), cell(DOTS, SCANLINES), IM_COL32(20, 20, 20, 255));
+        draw_list->AddRectFilled(cell(1, 0), cell(257, 240), IM_COL32(50, 50, 50, 255));
+        draw_list->AddRectFilled(cell(0, 241), cell(DOTS, 261), IM_COL32(30, 30, 70, 255));
+        for (const auto& event : events) {
+            const auto type = static_cast<size_t>(event.type);
+            if (!shown[type]) {
+                continue;
+            }
+            draw_list->AddRectFilled(
+                cell(event.dot, event.scanline),
+                cell(event.dot + 1, event.scanline + 1),
+                PPU_EVENT_STYLES[type].color
+            );
+        }
+
+        ImGui::InvisibleButton("##events", ImVec2(DOTS * CELL, SCANLINES * CELL));
+        if (ImGui::IsItemHovered()) {
+            const ImVec2 mouse = ImGui::GetMousePos();
+            const auto dot = static_cast<int>((mouse.x - origin.x) / CELL);
+            const auto scanline = static_cast<int>((mouse.y - origin.y) / CELL);
+
+            ImGui::BeginTooltip();
+            ImGui::Text("Scanline %d, dot %d", scanline, dot);
+            // Events a few dots either side, since single dots are hard to point at
+            for (const auto& event : events) {
+                const auto type = static_cast<size_t>(event.type);
+                if (!shown[type] || event.scanline != scanline || std::abs(event.dot - dot) > 2) {
+                    continue;
+                }
+                ImGui::TextColored(
+                    ImGui::ColorConvertU32ToFloat4(PPU_EVENT_STYLES[type].color),
+                    "%3u  %-15s $%04X = $%02X  PC $%04X",
+                    event.dot,
+                    PPU_EVENT_STYLES[type].name,
+                    event.address,
+                    event.value,
+                    event.pc
+                );
+            }
+            ImGui::EndTooltip();
+        }
+    }
+    ImGui::End();
+}
+
 void Ui::show_pattern_tables() {
     auto& open_panels = settings.GetOpenPanels();
 
@@ -1234,6 +1392,17 @@ void Ui::load_rom_file(const char* path) {
     const auto rom = ReadBinaryFile(loaded_rom_file_path.value());
     auto rom_args = RomArgs{rom};
     emulator_context = std::make_shared<Sen>(rom_args, audio_queue);
+    emulator_context->SetIdleLoopSkipping(settings.IdleLoopSkipping());
+    emulator_context->SetOutputThreads(settings.OutputThreads());
+    emulator_context->SetFrameEndCallback([this](const PpuFramebuffer&) {
+        // Start the audio once a few frames have buffered some
+        if (audio_frame_delay != 0) {
+            audio_frame_delay--;
+            if (audio_frame_delay == 0) {
+                audio_queue->resume();
+            }
+        }
+    });
     debugger = Debugger(emulator_context);
 
     const auto title = fmt::format("Sen - {}", loaded_rom_file_path->filename().string());
@@ -1243,40 +1412,19 @@ void Ui::load_rom_file(const char* path) {
 }
 
 std::vector<Pixel> Ui::render_pattern_table(
-    const std::array<byte, 0x1000>& pattern_table,
+    const std::array<byte, 128 * 128>& pattern_table,
     const std::array<byte, 32>& nes_palette,
     const int palette_id
 ) {
     static std::vector<Pixel> pixels(128 * 128);
 
-    for (size_t column = 0; column < 128; column++) {
-        const size_t tile_column = column / 8;
-        const size_t pixel_column_in_tile = column % 8;
-
-        for (size_t row = 0; row < 128; row++) {
-            const size_t tile_row = row / 8;
-            const size_t pixel_row_in_tile = 7 - (row % 8);
-
-            const size_t tile_index = tile_row + tile_column * 16;
-            const size_t pixel_row_bitplane_0_index = tile_index * 16 + pixel_column_in_tile;
-            const size_t pixel_row_bitplane_1_index = pixel_row_bitplane_0_index + 8;
+    for (size_t pixel_index = 0; pixel_index < pixels.size(); pixel_index++) {
+        const byte color_index = pattern_table[pixel_index];
 
-            const byte pixel_row_bitplane_0 = pattern_table[pixel_row_bitplane_0_index];
-            const byte pixel_row_bitplane_1 = pattern_table[pixel_row_bitplane_1_index];
+        // Skip the first byte for Universal background color
+        const auto nes_palette_color_index = ((palette_id & 0b111) << 2) | (color_index & 0b11);
 
-            const byte pixel_msb =
-                (pixel_row_bitplane_1 & (1 << pixel_row_in_tile)) != 0 ? 0b10 : 0b00;
-            const byte pixel_lsb =
-                (pixel_row_bitplane_0 & (1 << pixel_row_in_tile)) != 0 ? 0b01 : 0b00;
-
-            const byte color_index = pixel_msb | pixel_lsb;
-            const size_t pixel_index = row + column * 128;
-
-            // Skip the first byte for Universal background color
-            const auto nes_palette_color_index = ((palette_id & 0b111) << 2) | (color_index & 0b11);
-
-            pixels[pixel_index] = PALETTE_COLORS[nes_palette[nes_palette_color_index]];
-        }
+        pixels[pixel_index] = PALETTE_COLORS[nes_palette[nes_palette_color_index]];
     }
 
     return pixels;
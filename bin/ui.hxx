@@ -144,7 +144,7 @@ class Ui {
     static SDL_Gamepad* find_controllers();
 
     [[nodiscard]] static std::vector<Pixel> render_pattern_table(
-        const std::array<byte, 4096>& pattern_table,
+        const std::array<byte, 128 * 128>& pattern_table,
         const std::array<byte, 32>& nes_palette,
         int palette_id
     );
@@ -159,6 +159,7 @@ class Ui {
     void show_debugger();
     void show_volume_control();
     void show_logs();
+    void show_event_viewer();
 
     void
     draw_sprite(size_t index, const SpriteData& sprite, const std::array<byte, 32>& palettes) const;
@@ -9,8 +9,10 @@
 #include <array>
 #include <cstdint>
 #include <memory>
+#include <optional>
 
 #include "constants.hxx"
+#include "interrupts.hxx"
 
 constexpr std::array<byte, 4> DUTY_CYCLES = {
     0b10000000,
@@ -413,7 +415,7 @@ class ApuDmc {
     // is always sent to the mixer
     bool enabled{false};
 
-    explicit ApuDmc(InterruptRequestFlag irq_flag) : irq_flag{std::move(irq_flag)} {}
+    explicit ApuDmc(InterruptLines* interrupts) : interrupts{interrupts} {}
 
     [[nodiscard]] byte get_sample() const {
         return current_level;
@@ -454,7 +456,7 @@ class ApuDmc {
 
     constexpr static auto DMC_SAMPLE_BASE = 0xC000U;
         
-    InterruptRequestFlag irq_flag;
+    InterruptLines* interrupts;
 
     word sample_start_address{}, sample_length{};
     word current_sample_address{}, bytes_remaining_in_sample{};
@@ -465,6 +467,9 @@ class ApuDmc {
 
     void update_irq_loop_freq(const byte data) {
         irq_enable = (data & 0x80U) != 0x00U;
+        if (!irq_enable) {
+            interrupts->ReleaseIrq(IrqSource::Dmc);
+        }
         loop = (data & 0x40U) != 0x00U;
         rate_index = data & 0x0FU;
         timer = LEVEL_CHANGE_RATE.at(rate_index);
@@ -493,13 +498,16 @@ enum class ApuChannel : byte {
 
 class Apu {
   public:
-    explicit Apu(std::shared_ptr<AudioQueue> sink, InterruptRequestFlag irq_requested) :
+    explicit Apu(std::shared_ptr<AudioQueue> sink, InterruptLines* interrupts) :
         audio_queue{std::move(sink)},
-        dmc{irq_requested},
-        irq_requested(std::move(irq_requested)) {}
+        dmc{interrupts},
+        interrupts{interrupts} {}
 
     std::optional<word> Tick(uint64_t cpu_cycles);
 
+    // CPU cycles until the frame counter raises its IRQ, if it is going to
+    [[nodiscard]] std::optional<uint64_t> CyclesUntilFrameIrq(uint64_t cpu_cycles) const;
+
     [[maybe_unused]] static void Reset() {
         spdlog::error("Reset not implemented for APU");
     }
@@ -517,7 +525,7 @@ class Apu {
     ApuNoise noise;
     ApuDmc dmc;
 
-    InterruptRequestFlag irq_requested;
+    InterruptLines* interrupts;
 
     uint64_t frame_begin_cpu_cycle{0x00};
     FrameCounterStepMode step_mode{FrameCounterStepMode::FourStep};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "apu.hxx"
+#include "cartridge.hxx"
+#include "constants.hxx"
+#include "controller.hxx"
+#include "cpu.hxx"
+#include "interrupts.hxx"
+#include "ppu.hxx"
+#include "sen.hxx"
+
+class BatchCpu;
+
+// The bus of a single lane, for stepping it on its own with `Cpu`
+class LaneBus {
+  private:
+    BatchCpu* batch;
+    size_t lane;
+
+  public:
+    uint64_t& cycles; // CPU cycles executed by the lane since startup, kept by the `BatchCpu`
+
+    LaneBus(BatchCpu& batch, size_t lane);
+
+    void tick();
+    byte cpu_read(word address);
+    void cpu_write(word address, byte data);
+    byte ticked_cpu_read(word address);
+    void ticked_cpu_write(word address, byte data);
+    [[nodiscard]] std::span<const byte* const, 8> prg_windows() const;
+};
+
+// Experimental engine running many instances of the same ROM side by side, for workloads that
+// step thousands of them in lockstep. Registers are kept in one array per register and the
+// internal RAM of all instances (lanes) in one arena. While the lanes are about to execute the
+// same instruction it is decoded once and executed for all of them together, with the common
+// register and zero page instructions written as plain loops over the lanes that the compiler
+// can vectorize. Everything else, and every lane that diverges from the rest, is stepped by a
+// `Cpu` of its own.
+//
+// Bus accesses happen on the same cycles as with `Cpu`, but a lane only catches its PPU and APU
+// up to the CPU when it touches them or its cartridge, when one of them could have changed its
+// interrupt lines, and at the end of every frame. Lanes share the cartridge if it has no state of
+// its own (NROM with CHR-ROM), otherwise every lane gets its own mapping banks out of the same
+// ROM image
+class BatchCpu {
+  private:
+    size_t lane_count;
+
+    // Registers of every lane
+    std::vector<byte> a, x, y, s, p;
+    std::vector<word> pc;
+    std::vector<uint64_t> cycles; // CPU cycles executed by each lane since startup
+    std::vector<uint64_t> system_cycles; // CPU cycles the PPU and APU of each lane have run for
+    std::vector<uint64_t> carry_over_cycles;
+    // CPU cycle up to which the PPU and APU of each lane can't change its interrupt lines on their
+    // own. Stale once the lane touches either of them
+    std::vector<uint64_t> interrupt_deadlines;
+
+    std::vector<byte> ram; // IWRAM_SIZE bytes per lane
+
+    // Everything besides the CPU and RAM of each lane
+    std::vector<std::shared_ptr<Cartridge>> cartridges;
+    std::vector<std::shared_ptr<Ppu>> ppus;
+    std::vector<std::shared_ptr<Apu>> apus;
+    std::vector<std::shared_ptr<Controller>> controllers;
+    std::vector<InterruptLines> interrupts; // Never resized, the PPUs and APUs point into it
+
+    // Step lanes on their own. The registers above stay the lanes' own, they are copied in and out
+    // around every step
+    std::vector<Cpu<LaneBus>> cpus;
+
+    // Kept between frames
+    std::vector<uint64_t> target_cycles; // Where the current frame of each lane ends
+    std::vector<size_t> group; // Lanes at the same PC, stepped in lockstep
+    uint64_t group_cycles_left{}; // Until the first lane of the group reaches its target
+
+    bool shared_cartridge{false};
+    bool running{false};
+    bool lockstep{true};
+    uint64_t lockstep_instructions{}, scalar_instructions{};
+
+    [[nodiscard]] byte* lane_ram(const size_t lane) {
+        return ram.data() + lane * IWRAM_SIZE;
+    }
+
+    // Ticks the PPU and APU of `lane` up to the cycle its CPU is on
+    void catch_up(size_t lane);
+    // Catches `lane` up if its interrupt lines could have changed since it last was, so they can
+    // be polled
+    void catch_up_for_interrupts(size_t lane);
+
+    // Untimed bus accesses of a single lane, the same as `Bus::cpu_read` and `Bus::cpu_write`
+    byte cpu_read(size_t lane, word address);
+    void cpu_write(size_t lane, word address, byte data);
+
+    // Timed bus accesses of a single lane
+    byte read(size_t lane, word address);
+    void write(size_t lane, word address, byte data);
+    void idle(size_t lane);
+    void perform_oam_dma(size_t lane, byte high);
+
+    // Runs the startup procedure of every lane
+    void start();
+    void start_lane(size_t lane);
+    void step_lane(size_t lane);
+    void run_lane_to_frame_end(size_t lane);
+
+    // Drops the lanes that finished their frame or are not at the PC most of the group is at from
+    // the group, they run the rest of the frame on their own
+    void regroup();
+
+    // Executes the instruction at `pc` for all `lanes`, which must all be at `pc`. Returns false
+    // without executing anything if it has no batched implementation or a lane has an interrupt
+    // to service first. `diverged` is set if a branch sent the lanes to different PCs
+    template<typename LaneRange>
+    bool step_together(const LaneRange& lanes, word pc, bool& diverged);
+
+  public:
+    BatchCpu(const RomArgs& rom_args, size_t lanes);
+
+    // The PPUs and APUs point back into the lanes
+    BatchCpu(const BatchCpu&) = delete;
+    BatchCpu& operator=(const BatchCpu&) = delete;
+
+    [[nodiscard]] size_t lanes() const {
+        return lane_count;
+    }
+
+    // Runs every lane for one frame worth of CPU cycles, without drawing anything unless `render`
+    void run_for_one_frame(bool render = true);
+
+    // With lockstep disabled every lane is always stepped on its own
+    void set_lockstep(const bool enabled) {
+        lockstep = enabled;
+    }
+
+    void set_pressed_keys(size_t lane, ControllerPort port, byte keys) const;
+
+    // Observations of the current frame of a lane, the same as `Sen::ObserveLuma()` and friends
+    void observe_luma(size_t lane, std::span<byte> luma, size_t width, size_t height) const;
+    void observe_ram(size_t lane, std::span<byte, IWRAM_SIZE> ram) const;
+    void observe_nametable(size_t lane, std::span<byte, NAMETABLE_TILES> tiles) const;
+
+    [[nodiscard]] uint64_t frame_count(const size_t lane) const {
+        return ppus[lane]->frame_count;
+    }
+
+    // Instructions executed by lanes in lockstep and on their own since startup
+    [[nodiscard]] uint64_t lockstep_instruction_count() const {
+        return lockstep_instructions;
+    }
+
+    [[nodiscard]] uint64_t scalar_instruction_count() const {
+        return scalar_instructions;
+    }
+
+    friend class Debugger;
+    friend class LaneBus;
+};
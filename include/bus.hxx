@@ -4,6 +4,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -21,6 +23,10 @@ class Bus {
     std::shared_ptr<Apu> apu;
     std::shared_ptr<Controller> controller;
 
+    // RAM address, without mirroring, whose writes are being watched for. 0xFFFF for none
+    word watched_ram_address{0xFFFF};
+    bool watched_ram_written{false};
+
   public:
     uint64_t cycles{0}; // CPU cycles executed since startup
 
@@ -36,9 +42,28 @@ class Bus {
         spdlog::debug("Initialized system bus");
     }
 
+    [[nodiscard]] std::span<const byte, IWRAM_SIZE> ram() const {
+        return std::span<const byte, IWRAM_SIZE>{internal_ram.data(), IWRAM_SIZE};
+    }
+
+    // Watches for writes to `address` in RAM or any of its mirrors, or stops watching
+    void watch_ram_writes(const std::optional<word> address) {
+        watched_ram_address = address ? *address % IWRAM_SIZE : 0xFFFF;
+        watched_ram_written = false;
+    }
+
+    // If the watched address was written to since the last call
+    bool take_watched_ram_write() {
+        return std::exchange(watched_ram_written, false);
+    }
+
     [[nodiscard]] byte cpu_read(word address) const;
     void cpu_write(word address, byte data);
 
+    [[nodiscard]] std::span<const byte* const, 8> prg_windows() const {
+        return cartridge->mapped_prg_windows();
+    }
+
     byte ticked_cpu_read(const word address) {
         tick();
         return cpu_read(address);
@@ -53,14 +78,21 @@ class Bus {
         cycles++;
 #ifndef CPU_TEST
         // Each CPU cycle is 3 PPU cycles
-        ppu->Tick();
-        ppu->Tick();
-        ppu->Tick();
+        ppu->Tick(cycles);
+        ppu->Tick(cycles);
+        ppu->Tick(cycles);
 
         apu->Tick(cycles);
 #endif
     }
 
+    // Advance the rest of the system by `count` CPU cycles without the CPU touching the bus
+    void idle(const uint64_t count) {
+        for (uint64_t i = 0; i < count; i++) {
+            tick();
+        }
+    }
+
     void perform_oam_dma(byte high);
 
     friend class Debugger;
@@ -2,42 +2,174 @@
 
 #include <spdlog/spdlog.h>
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
 
+#include "chr_tile_cache.hxx"
 #include "constants.hxx"
+#include "interrupts.hxx"
+#include "rom_image.hxx"
 
-enum Mirroring {
-    Horizontal,
-    Vertical,
-    FourScreenVram,
-};
+// Base of every mapper. The CPU and PPU see the cartridge through windows into host memory,
+// eight 4KB PRG windows over $8000-$FFFF and eight 1KB CHR windows over $0000-$1FFF, plus the
+// PRG-RAM at $6000-$7FFF. Accesses read and write through them directly. Mappers only implement
+// their registers and point the windows at other banks when those change, starting out with
+// the first 32KB of PRG-ROM and the first 8KB of CHR mapped. PRG-ROM and CHR-ROM stay in the
+// shared `RomImage`, only PRG-RAM and CHR-RAM belong to the cartridge
+class Cartridge {
+  protected:
+    static constexpr size_t PRG_WINDOW_SIZE = 0x1000;
+    static constexpr size_t CHR_WINDOW_SIZE = 0x400;
 
-struct RomHeader {
-    size_t prg_rom_size;
-    size_t prg_rom_banks;
+    // Changes every time the nametable mirroring does, mappers must bump this when `mirroring()`
+    // changes
+    uint32_t mirroring_generation{1};
 
-    size_t chr_rom_size;
-    size_t chr_rom_banks;
+    std::shared_ptr<const RomImage> image;
+    bool chr_ram; // The cartridge has 8KB of CHR-RAM instead of CHR-ROM
+    std::span<const byte> prg_rom; // Into `image`
+    std::vector<byte> writable_chr; // The CHR-RAM, empty with CHR-ROM
+    std::span<const byte> chr; // CHR-ROM in `image` or `writable_chr`
+    std::vector<byte> prg_ram{}; // Empty unless the mapper has PRG-RAM
+    // For mappers that can switch the PRG-RAM off or protect it from writes
+    bool prg_ram_enabled{true};
+    bool prg_ram_writable{true};
+    ChrTileCache chr_cache; // Of CHR-RAM, CHR-ROM is decoded in `image`
 
-    size_t prg_ram_size;
+    std::array<const byte*, 8> prg_windows{};
+    std::array<const byte*, 8> chr_windows{};
 
-    Mirroring hardware_mirroring;
-    word mapper_number;
-    bool battery_backed_ram = false;
-};
+    InterruptLines* interrupts{}; // For mappers with an IRQ of their own
+    // Set by mappers that count PPU A12 rises, the PPU doesn't work them out otherwise
+    bool watches_a12{false};
+
+    // Maps the `size` bytes from `address` on to PRG-ROM or CHR from `offset` on. Offsets wrap
+    // around the size of the memory, as bank bits beyond it are not connected on the board
+    void map_prg(const word address, const size_t size, const size_t offset) {
+        for (size_t page = 0; page < size / PRG_WINDOW_SIZE; page++) {
+            prg_windows[(address - 0x8000) / PRG_WINDOW_SIZE + page] =
+                prg_rom.data() + (offset + page * PRG_WINDOW_SIZE) % prg_rom.size();
+        }
+    }
+
+    void map_chr(const word address, const size_t size, const size_t offset) {
+        for (size_t page = 0; page < size / CHR_WINDOW_SIZE; page++) {
+            chr_windows[address / CHR_WINDOW_SIZE + page] =
+                chr.data() + (offset + page * CHR_WINDOW_SIZE) % chr.size();
+        }
+    }
+
+    // Writes to $8000-$FFFF
+    virtual void register_write(uint64_t cpu_cycle, word address, byte data) = 0;
+
+    // Offset into CHR memory that pattern table `address` is mapped to
+    [[nodiscard]] size_t chr_offset(const word address) const {
+        const byte* const window = chr_windows[(address / CHR_WINDOW_SIZE) % 8];
+        return (window - chr.data()) + address % CHR_WINDOW_SIZE;
+    }
 
-class Cartridge {
   public:
     RomHeader header;
 
-    explicit Cartridge(const RomHeader& header) : header{header} {}
+    explicit Cartridge(std::shared_ptr<const RomImage> rom_image) :
+        image{std::move(rom_image)},
+        chr_ram{image->chr_rom.empty()},
+        prg_rom{image->prg_rom},
+        writable_chr(chr_ram ? 0x2000 : 0, 0x00),
+        chr{chr_ram ? std::span<const byte>{writable_chr} : std::span{image->chr_rom}},
+        chr_cache{writable_chr.size()},
+        header{image->header} {
+        map_prg(0x8000, 0x8000, 0);
+        map_chr(0x0000, 0x2000, 0);
+    }
+
+    // The windows point into the cartridge itself
+    Cartridge(const Cartridge&) = delete;
+    Cartridge& operator=(const Cartridge&) = delete;
+
+    // The eight 4KB windows over $8000-$FFFF. They are updated in place as banks are switched, so
+    // the CPU fetches code straight through them
+    [[nodiscard]] std::span<const byte* const, 8> mapped_prg_windows() const {
+        return prg_windows;
+    }
+
+    [[nodiscard]] uint32_t nametable_generation() const {
+        return mirroring_generation;
+    }
+
+    [[nodiscard]] bool has_chr_ram() const {
+        return chr_ram;
+    }
+
+    [[nodiscard]] const std::shared_ptr<const RomImage>& rom_image() const {
+        return image;
+    }
+
+    // Host memory of the cartridge's own, PRG-RAM, CHR-RAM and its decoded tiles. The ROM image
+    // it maps its banks from is shared and not counted
+    [[nodiscard]] size_t private_footprint() const {
+        return sizeof(Cartridge) + prg_ram.size() + writable_chr.size() + chr_cache.footprint();
+    }
+
+    void connect_interrupts(InterruptLines* lines) {
+        interrupts = lines;
+    }
+
+    [[nodiscard]] bool watches_ppu_a12() const {
+        return watches_a12;
+    }
 
-    virtual byte cpu_read(uint64_t cpu_cycle, word address) = 0;
-    virtual void cpu_write(uint64_t cpu_cycle, word address, byte data) = 0;
+    // PPU address line A12 rose for a pattern fetch on `cpu_cycle`, after staying low for long
+    // enough to get through the filter MMC3 boards put on it. Only called if `watches_ppu_a12()`
+    virtual void ppu_a12_rise([[maybe_unused]] uint64_t cpu_cycle) {}
+
+    // Rises of A12 left until the mapper asserts its IRQ, if it is going to
+    [[nodiscard]] virtual std::optional<unsigned int> a12_rises_until_irq() const {
+        return std::nullopt;
+    }
 
-    virtual byte ppu_read(word address) = 0;
-    virtual void ppu_write(word address, byte data) = 0;
+    // $4020-$FFFF, nothing answers below the PRG-RAM
+    [[nodiscard]] byte cpu_read([[maybe_unused]] uint64_t cpu_cycle, const word address) const {
+        if (address >= 0x8000) {
+            return prg_windows[(address - 0x8000) / PRG_WINDOW_SIZE][address % PRG_WINDOW_SIZE];
+        }
+        if (address >= 0x6000 && prg_ram_enabled && !prg_ram.empty()) {
+            return prg_ram[(address - 0x6000) % prg_ram.size()];
+        }
+        return 0x00;
+    }
+
+    void cpu_write(const uint64_t cpu_cycle, const word address, const byte data) {
+        if (address >= 0x8000) {
+            register_write(cpu_cycle, address, data);
+        } else if (address >= 0x6000 && prg_ram_writable && !prg_ram.empty()) {
+            prg_ram[(address - 0x6000) % prg_ram.size()] = data;
+        }
+    }
+
+    [[nodiscard]] byte ppu_read(const word address) const {
+        return chr_windows[(address / CHR_WINDOW_SIZE) % 8][address % CHR_WINDOW_SIZE];
+    }
+
+    void ppu_write(const word address, const byte data) {
+        if (chr_ram) {
+            const size_t offset = chr_offset(address);
+            writable_chr[offset] = data;
+            chr_cache.invalidate(offset);
+        }
+    }
+
+    // Decoded pixels of the tile row whose low bit plane is at pattern table `address`
+    const DecodedTileRow& ppu_tile_row(const word address) {
+        const size_t offset = chr_offset(address);
+        return chr_ram ? chr_cache.row(chr, offset) : image->chr_tiles.decoded_row(offset);
+    }
 
     [[nodiscard]] virtual Mirroring mirroring() const {
         return header.hardware_mirroring;
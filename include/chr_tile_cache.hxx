@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "constants.hxx"
+
+// One 8 pixel row of a tile with both bit planes combined into a 2-bit color index per pixel,
+// left to right, and the same row mirrored for horizontally flipped sprites
+struct DecodedTileRow {
+    std::array<byte, 8> pixels;
+    std::array<byte, 8> flipped;
+};
+
+// Decoded copy of CHR memory. The one for CHR-ROM is decoded whole when the ROM image is loaded
+// and only read from then on. For CHR-RAM each cartridge keeps its own, rows are decoded a 1KB
+// bank at a time on first use, and a bank is decoded again after anything writes into it
+class ChrTileCache {
+  public:
+    static constexpr size_t BANK_SIZE = 0x400;
+
+    explicit ChrTileCache(const size_t chr_size) :
+        rows(chr_size / 2),
+        bank_valid((chr_size + BANK_SIZE - 1) / BANK_SIZE, false) {}
+
+    // `offset` is the offset of the low bit plane byte of the row into CHR memory
+    const DecodedTileRow& row(const std::span<const byte> chr, const size_t offset) {
+        const size_t bank = offset / BANK_SIZE;
+        if (!bank_valid[bank]) {
+            decode_bank(chr, bank);
+        }
+        return rows[row_index(offset)];
+    }
+
+    // Only once `decode_all()` ran, nothing is decoded on the way
+    [[nodiscard]] const DecodedTileRow& decoded_row(const size_t offset) const {
+        return rows[row_index(offset)];
+    }
+
+    void decode_all(const std::span<const byte> chr) {
+        for (size_t bank = 0; bank < bank_valid.size(); bank++) {
+            decode_bank(chr, bank);
+        }
+    }
+
+    void invalidate(const size_t offset) {
+        bank_valid[offset / BANK_SIZE] = false;
+    }
+
+    [[nodiscard]] size_t footprint() const {
+        return rows.size() * sizeof(DecodedTileRow) + bank_valid.size() / 8;
+    }
+
+  private:
+    std::vector<DecodedTileRow> rows; // 8 per 16 byte tile
+    std::vector<bool> bank_valid;
+
+    [[nodiscard]] static size_t row_index(const size_t offset) {
+        return ((offset >> 4) << 3) | (offset & 0x07);
+    }
+
+    // Each bit of a bit plane byte spread out into its own byte, most significant bit first
+    static constexpr std::array<std::array<byte, 8>, 256> SPREAD_BITS = [] {
+        std::array<std::array<byte, 8>, 256> table{};
+        for (size_t plane = 0; plane < table.size(); plane++) {
+            for (size_t x = 0; x < 8; x++) {
+                table[plane][x] = (plane >> (7 - x)) & 0b1;
+            }
+        }
+        return table;
+    }();
+
+    void decode_bank(const std::span<const byte> chr, const size_t bank) {
+        const size_t end = std::min((bank + 1) * BANK_SIZE, chr.size());
+        for (size_t tile = bank * BANK_SIZE; tile < end; tile += 16) {
+            for (size_t fine_y = 0; fine_y < 8; fine_y++) {
+                const auto& lsb = SPREAD_BITS[chr[tile + fine_y]];
+                const auto& msb = SPREAD_BITS[chr[tile + fine_y + 8]];
+                auto& [pixels, flipped] = rows[row_index(tile + fine_y)];
+                for (size_t x = 0; x < 8; x++) {
+                    pixels[x] = (msb[x] << 1) | lsb[x];
+                    flipped[7 - x] = pixels[x];
+                }
+            }
+        }
+        bank_valid[bank] = true;
+    }
+};
@@ -1,14 +1,14 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <memory>
 
 constexpr int NES_WIDTH = 256;
 constexpr int NES_HEIGHT = 240;
+constexpr size_t NAMETABLE_TILES = 32 * 30;
 
 using byte = uint8_t;
 using word = uint16_t;
-using InterruptRequestFlag = std::shared_ptr<bool>;
 
 // Clocks and timings
 constexpr uint64_t NTSC_NES_CLOCK_FREQ{1789773};
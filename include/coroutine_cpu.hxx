@@ -0,0 +1,820 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#include "constants.hxx"
+#include "cpu.hxx"
+#include "interrupts.hxx"
+
+// A single bus cycle requested by `CoroutineCpu`
+struct BusCycle {
+    enum class Kind : byte {
+        Read,
+        // A read of code, out of the PRG windows if the bus has them
+        Fetch,
+        Write,
+        Idle,
+        // Not a bus cycle. The CPU is between two instructions
+        None,
+    };
+
+    Kind kind{Kind::Idle};
+    word address{};
+    byte data{};
+};
+
+// Coroutine that suspends once per bus cycle. The cycle it is suspended on is kept in its promise
+// and has to be carried out by whoever resumes it. Reads store the value read back into the cycle
+class BusCycleTask {
+  public:
+    struct promise_type {
+        BusCycle cycle{};
+
+        BusCycleTask get_return_object() {
+            return BusCycleTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    BusCycleTask() = default;
+
+    explicit BusCycleTask(const std::coroutine_handle<promise_type> handle) : handle{handle} {}
+
+    BusCycleTask(const BusCycleTask&) = delete;
+    BusCycleTask& operator=(const BusCycleTask&) = delete;
+
+    BusCycleTask(BusCycleTask&& other) noexcept : handle{std::exchange(other.handle, {})} {}
+
+    BusCycleTask& operator=(BusCycleTask&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+
+    ~BusCycleTask() {
+        destroy();
+    }
+
+    [[nodiscard]] bool valid() const {
+        return static_cast<bool>(handle);
+    }
+
+    [[nodiscard]] BusCycle& cycle() const {
+        return handle.promise().cycle;
+    }
+
+    void resume() const {
+        handle.resume();
+    }
+
+  private:
+    std::coroutine_handle<promise_type> handle{};
+
+    void destroy() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+};
+
+// Awaited by the CPU coroutine for every bus cycle it needs
+struct BusCycleAwaiter {
+    BusCycle cycle;
+    BusCycle* pending{};
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(const std::coroutine_handle<BusCycleTask::promise_type> handle) noexcept {
+        pending = &handle.promise().cycle;
+        *pending = cycle;
+    }
+
+    [[nodiscard]] byte await_resume() const noexcept {
+        return pending->data;
+    }
+};
+
+// Alternative to `Cpu` written as a single coroutine that suspends before every bus cycle instead
+// of ticking the bus from inside the opcode. Whoever drives it decides when each cycle happens, so
+// it can be stopped and inspected between any two cycles of an instruction. Bus accesses and their
+// timing are the same as `Cpu`, and so are the code fetch through the PRG windows, idle loop
+// detection and jamming
+template<SystemBus BusType>
+class CoroutineCpu {
+  private:
+    byte a{0x00}; // Accumulator
+    byte x{0x00}, y{0x00}; // General purpose registers
+    word pc{0x0000}; // Program counter
+    byte s{0xFD}; // Stack pointer
+    byte p{0x34}; // Status register
+
+    std::shared_ptr<BusType> bus{};
+    InterruptLines* interrupts{};
+
+    // Same as in `Cpu`
+    const byte* const* prg_windows{};
+    IdleLoopDetector idle_loops{};
+    bool jam_executed{false};
+
+    BusCycleTask task{};
+    bool reset_pending{false};
+
+    static BusCycleAwaiter read(const word address) {
+        return {.cycle = {.kind = BusCycle::Kind::Read, .address = address, .data = 0x00}};
+    }
+
+    static BusCycleAwaiter fetch(const word address) {
+        return {.cycle = {.kind = BusCycle::Kind::Fetch, .address = address, .data = 0x00}};
+    }
+
+    static BusCycleAwaiter write(const word address, const byte data) {
+        return {.cycle = {.kind = BusCycle::Kind::Write, .address = address, .data = data}};
+    }
+
+    static BusCycleAwaiter idle() {
+        return {.cycle = {.kind = BusCycle::Kind::Idle, .address = 0x0000, .data = 0x00}};
+    }
+
+    static BusCycleAwaiter instruction_boundary() {
+        return {.cycle = {.kind = BusCycle::Kind::None, .address = 0x0000, .data = 0x00}};
+    }
+
+    static word stack(const byte pointer) {
+        return 0x100 + static_cast<word>(pointer);
+    }
+
+    void update_zero_negative(const byte value) {
+        update_flag(StatusFlag::Zero, value == 0x00);
+        update_flag(StatusFlag::Negative, (value & 0x80) != 0x00);
+    }
+
+    void add_with_carry(word operand);
+
+    BusCycleTask run();
+
+    void ensure_running() {
+        if (!task.valid()) {
+            task = run();
+            task.resume();
+        }
+    }
+
+  public:
+    CoroutineCpu(std::shared_ptr<BusType> bus, InterruptLines* interrupts) :
+        bus{std::move(bus)},
+        interrupts{interrupts} {
+        if constexpr (PrgWindowedBus<BusType>) {
+            prg_windows = this->bus->prg_windows().data();
+        }
+    }
+
+    // The coroutine frame points back to the CPU
+    CoroutineCpu(const CoroutineCpu&) = delete;
+    CoroutineCpu& operator=(const CoroutineCpu&) = delete;
+    CoroutineCpu(CoroutineCpu&&) = delete;
+    CoroutineCpu& operator=(CoroutineCpu&&) = delete;
+    ~CoroutineCpu() = default;
+
+    [[nodiscard]] bool flag_set(StatusFlag flag) const {
+        return (p & static_cast<byte>(flag)) != 0;
+    }
+
+    void update_flag(StatusFlag flag, const bool value) {
+        if (value) {
+            p |= static_cast<byte>(flag);
+        } else {
+            p &= ~static_cast<byte>(flag);
+        }
+    }
+
+    // Runs the CPU startup procedure. Should run for 7 NES cycles
+    void start() {
+        reset_pending = true;
+        step();
+    }
+
+    // Carries out the bus cycle the CPU is waiting on and runs it up to the next one
+    void tick() {
+        ensure_running();
+
+        if (task.cycle().kind == BusCycle::Kind::None) {
+            // Start the next instruction, checking for interrupts
+            task.resume();
+        }
+
+        auto& cycle = task.cycle();
+        switch (cycle.kind) {
+            case BusCycle::Kind::Read:
+                cycle.data = bus->ticked_cpu_read(cycle.address);
+                break;
+            case BusCycle::Kind::Fetch:
+                if constexpr (PrgWindowedBus<BusType>) {
+                    if (cycle.address >= PRG_ROM_START) {
+                        bus->tick();
+                        cycle.data = prg_windows[(cycle.address - PRG_ROM_START) / PRG_WINDOW_SIZE]
+                                                [cycle.address % PRG_WINDOW_SIZE];
+                        break;
+                    }
+                }
+                cycle.data = bus->ticked_cpu_read(cycle.address);
+                break;
+            case BusCycle::Kind::Write:
+                bus->ticked_cpu_write(cycle.address, cycle.data);
+                break;
+            case BusCycle::Kind::Idle:
+                bus->tick();
+                break;
+            case BusCycle::Kind::None:
+                break;
+        }
+
+        task.resume();
+    }
+
+    // Runs the rest of the current instruction, or the next one (after servicing any pending
+    // interrupt) if the CPU is between instructions
+    void step() {
+        do {
+            tick();
+        } while (task.cycle().kind != BusCycle::Kind::None);
+    }
+
+    // The bus cycle the CPU will perform next
+    [[nodiscard]] BusCycle pending_cycle() {
+        ensure_running();
+        return task.cycle();
+    }
+
+    void set_idle_loop_detection(const bool enabled) {
+        idle_loops.set_enabled(enabled);
+    }
+
+    // See `Cpu`
+    [[nodiscard]] uint64_t idle_loop_cycles() const {
+        return idle_loops.idle_loop_cycles();
+    }
+
+    [[nodiscard]] bool loop_iteration_ended() const {
+        return idle_loops.iteration_ended(bus->cycles);
+    }
+
+    [[nodiscard]] bool idle_loop_polls_ppu_status() const {
+        return idle_loops.idle_loop_polls_ppu_status();
+    }
+
+    [[nodiscard]] word program_counter() const {
+        return pc;
+    }
+
+    [[nodiscard]] bool jammed() const {
+        return jam_executed;
+    }
+
+    friend class Debugger;
+};
+
+template<SystemBus BusType>
+void CoroutineCpu<BusType>::add_with_carry(const word operand) {
+    const auto temp_a = static_cast<word>(a);
+    const word result =
+        temp_a + operand + static_cast<word>(p & static_cast<byte>(StatusFlag::Carry));
+
+    update_flag(StatusFlag::Zero, (result & 0xFF) == 0x00);
+    update_flag(StatusFlag::Negative, (result & 0x80) != 0x00);
+    update_flag(StatusFlag::Carry, result > 0xFF);
+    update_flag(StatusFlag::Overflow, ((~(temp_a ^ operand) & (temp_a ^ result)) & 0x80) != 0x00);
+
+    a = static_cast<byte>(result);
+}
+
+template<SystemBus BusType>
+BusCycleTask CoroutineCpu<BusType>::run() {
+    using Mode = AddressingMode;
+
+    for (;;) {
+        co_await instruction_boundary();
+
+        if (reset_pending) {
+            reset_pending = false;
+
+            co_await read(0x0000); // Address does not matter
+            co_await read(0x0001); // First start state
+            co_await read(stack(s)); // Second start state
+            co_await read(stack(s - 1)); // Third start state
+            co_await read(stack(s - 2)); // Fourth start state
+            const auto pcl = static_cast<word>(co_await read(Cpu<BusType>::RESET_VECTOR));
+            const auto pch = static_cast<word>(co_await read(Cpu<BusType>::RESET_VECTOR + 1));
+            pc = (pch << 8) | pcl;
+            spdlog::info("Starting execution at {:#06X}", pc);
+            continue;
+        }
+
+        const auto poll_cycle = bus->cycles;
+        const bool nmi = interrupts->NmiPolled(poll_cycle);
+        if (nmi
+            || (!flag_set(StatusFlag::InterruptDisable) && interrupts->IrqPolled(poll_cycle))) {
+            if (nmi) {
+                interrupts->AcknowledgeNmi();
+            }
+            idle_loops.interrupted();
+
+            co_await read(pc);
+            co_await read(pc);
+            co_await write(stack(s--), static_cast<byte>(pc >> 8));
+            co_await write(stack(s--), static_cast<byte>(pc));
+
+            // Ensure the B flag is not set when pushing
+            update_flag(StatusFlag::B, false);
+            p |= (1 << 5); // The unused flag is set when pushing by NMI
+            co_await write(stack(s--), p);
+            update_flag(StatusFlag::InterruptDisable, true);
+
+            const word vector = nmi ? Cpu<BusType>::NMI_VECTOR : Cpu<BusType>::IRQ_VECTOR;
+            const auto pcl = static_cast<word>(co_await read(vector));
+            const auto pch = static_cast<word>(co_await read(vector + 1));
+            pc = (pch << 8) | pcl;
+        }
+
+        // Only move the PC once the opcode is fetched, so it points at the instruction while the
+        // CPU waits on the fetch
+        const word opcode_pc = pc;
+        const Opcode& opcode = OPCODES[co_await fetch(pc)];
+        pc++;
+        const Mode mode = opcode.addressing_mode;
+
+        // Effective address
+        word address{};
+        bool page_crossed = false;
+        if (mode != Mode::Implied && mode != Mode::Accumulator && mode != Mode::Relative
+            && opcode.opcode_class != OpcodeClass::JSR) {
+            switch (mode) {
+                case Mode::Immediate:
+                    address = pc++;
+                    break;
+                case Mode::ZeroPage:
+                    address = co_await fetch(pc++);
+                    break;
+                case Mode::ZeroPageX:
+                case Mode::ZeroPageY: {
+                    const auto base = static_cast<word>(co_await fetch(pc++));
+                    co_await idle(); // Dummy read cycle
+                    address = non_page_crossing_add(base, mode == Mode::ZeroPageX ? x : y);
+                    break;
+                }
+                case Mode::Absolute:
+                case Mode::AbsoluteXIndexed:
+                case Mode::AbsoluteYIndexed:
+                case Mode::Indirect: {
+                    const auto low = static_cast<word>(co_await fetch(pc++));
+                    const auto high = static_cast<word>(co_await fetch(pc++));
+                    address = (high << 8) | low;
+
+                    if (mode == Mode::Indirect) {
+                        const auto target_low = static_cast<word>(co_await read(address));
+                        const auto target_high = static_cast<word>(
+                            co_await read(non_page_crossing_add(address, 1))
+                        );
+                        address = (target_high << 8) | target_low;
+                    } else if (mode != Mode::Absolute) {
+                        const byte index = mode == Mode::AbsoluteXIndexed ? x : y;
+                        const word indexed = address + index;
+                        if (indexed != non_page_crossing_add(address, index)) {
+                            // If a page was crossed we require an additional cycle
+                            co_await idle(); // Dummy read cycle
+                            page_crossed = true;
+                        }
+                        address = indexed;
+                    }
+                    break;
+                }
+                case Mode::IndirectX: {
+                    const auto operand = static_cast<word>(co_await fetch(pc++));
+                    const word pointer = operand + x;
+                    co_await read(operand); // Dummy read cycle
+
+                    const auto low = static_cast<word>(co_await read(pointer & 0xFF));
+                    const auto high = static_cast<word>(co_await read((pointer + 1) & 0xFF));
+                    address = (high << 8) | low;
+                    break;
+                }
+                case Mode::IndirectY: {
+                    const auto pointer = static_cast<word>(co_await fetch(pc++));
+                    const auto low = static_cast<word>(co_await read(pointer));
+                    const auto high = static_cast<word>(co_await read((pointer + 1) & 0xFF));
+
+                    const word effective = (high << 8) | low;
+                    const word non_page_crossed = non_page_crossing_add(effective, y);
+                    co_await read(non_page_crossed);
+
+                    address = effective + static_cast<word>(y);
+                    page_crossed = address != non_page_crossed;
+                    break;
+                }
+                default:
+                    spdlog::error("Invalid addressing mode for effective address");
+                    std::exit(-1);
+            }
+        }
+
+        // Instructions that only read memory fetch their operand here. Loads through (Indirect),Y
+        // already did the timed read if no page was crossed
+        byte operand{};
+        switch (opcode.opcode_class) {
+            case OpcodeClass::LDA:
+            case OpcodeClass::AND:
+            case OpcodeClass::ORA:
+            case OpcodeClass::EOR:
+            case OpcodeClass::ADC:
+            case OpcodeClass::SBC:
+            case OpcodeClass::CMP:
+                if (mode == Mode::IndirectY && !page_crossed) {
+                    operand = bus->cpu_read(address);
+                    break;
+                }
+                [[fallthrough]];
+            case OpcodeClass::LDX:
+            case OpcodeClass::LDY:
+            case OpcodeClass::CPX:
+            case OpcodeClass::CPY:
+            case OpcodeClass::BIT:
+                operand = co_await read(address);
+                break;
+            default:
+                break;
+        }
+
+        // Indexed stores and read-modify-writes always take the page crossing cycle
+        const bool indexed_dummy_read =
+            (mode == Mode::AbsoluteXIndexed || mode == Mode::AbsoluteYIndexed) && !page_crossed;
+
+        switch (opcode.opcode_class) {
+            case OpcodeClass::LDA:
+                a = operand;
+                update_zero_negative(a);
+                break;
+            case OpcodeClass::LDX:
+                x = operand;
+                update_zero_negative(x);
+                break;
+            case OpcodeClass::LDY:
+                y = operand;
+                update_zero_negative(y);
+                break;
+            case OpcodeClass::STA:
+            case OpcodeClass::STX:
+            case OpcodeClass::STY: {
+                if (indexed_dummy_read) {
+                    co_await read(address); // Dummy read cycle
+                }
+                const auto opcode_class = opcode.opcode_class;
+                const byte data =
+                    opcode_class == OpcodeClass::STA ? a : (opcode_class == OpcodeClass::STX ? x : y);
+                co_await write(address, data);
+                break;
+            }
+            case OpcodeClass::AND:
+                a &= operand;
+                update_zero_negative(a);
+                break;
+            case OpcodeClass::ORA:
+                a |= operand;
+                update_zero_negative(a);
+                break;
+            case OpcodeClass::EOR:
+                a ^= operand;
+                update_zero_negative(a);
+                break;
+            case OpcodeClass::ADC:
+                add_with_carry(operand);
+                break;
+            case OpcodeClass::SBC:
+                add_with_carry(operand ^ 0x00FF);
+                break;
+            case OpcodeClass::CMP:
+            case OpcodeClass::CPX:
+            case OpcodeClass::CPY: {
+                const byte reg = opcode.opcode_class == OpcodeClass::CMP
+                    ? a
+                    : (opcode.opcode_class == OpcodeClass::CPX ? x : y);
+                update_zero_negative(reg - operand);
+                // The carry flag is set if no borrow or greater than or equal for A - M
+                update_flag(StatusFlag::Carry, reg >= operand);
+                break;
+            }
+            case OpcodeClass::BIT:
+                update_flag(StatusFlag::Negative, (operand & 0x80) != 0x00);
+                update_flag(StatusFlag::Overflow, (operand & 0x40) != 0x00);
+                update_flag(StatusFlag::Zero, (operand & a) == 0x00);
+                break;
+            case OpcodeClass::INC:
+            case OpcodeClass::DEC: {
+                if (indexed_dummy_read) {
+                    co_await read(address); // Dummy read cycle
+                }
+                operand = co_await read(address);
+                co_await write(address, operand); // Dummy write cycle
+
+                const byte result =
+                    opcode.opcode_class == OpcodeClass::INC ? operand + 1 : operand - 1;
+                update_zero_negative(result);
+                co_await write(address, result);
+                break;
+            }
+            case OpcodeClass::ASL:
+            case OpcodeClass::LSR:
+            case OpcodeClass::ROL:
+            case OpcodeClass::ROR: {
+                operand = a;
+                if (mode != Mode::Accumulator) {
+                    if (indexed_dummy_read) {
+                        co_await read(address); // Dummy read cycle
+                    }
+                    operand = co_await read(address);
+                }
+
+                const byte carry_in = flag_set(StatusFlag::Carry) ? 1 : 0;
+                byte result{};
+                switch (opcode.opcode_class) {
+                    case OpcodeClass::ASL:
+                        result = operand << 1;
+                        update_flag(StatusFlag::Carry, (operand & 0x80) != 0x00);
+                        break;
+                    case OpcodeClass::LSR:
+                        result = operand >> 1;
+                        update_flag(StatusFlag::Carry, (operand & 0b1) != 0x00);
+                        break;
+                    case OpcodeClass::ROL:
+                        result = (operand << 1) | carry_in;
+                        update_flag(StatusFlag::Carry, (operand & 0x80) != 0x00);
+                        break;
+                    default:
+                        result = (operand >> 1) | (carry_in << 7);
+                        update_flag(StatusFlag::Carry, (operand & 0b1) != 0x00);
+                        break;
+                }
+                update_zero_negative(result);
+                co_await idle(); // Dummy read cycle
+
+                if (mode == Mode::Accumulator) {
+                    a = result;
+                } else {
+                    co_await write(address, result);
+                }
+                break;
+            }
+            case OpcodeClass::BCC:
+            case OpcodeClass::BCS:
+            case OpcodeClass::BEQ:
+            case OpcodeClass::BMI:
+            case OpcodeClass::BNE:
+            case OpcodeClass::BPL:
+            case OpcodeClass::BVC:
+            case OpcodeClass::BVS: {
+                // First change the type, then the size, then type again
+                const auto offset = static_cast<word>(
+                    static_cast<int16_t>(static_cast<int8_t>(co_await fetch(pc++)))
+                );
+
+                bool condition = false;
+                switch (opcode.opcode_class) {
+                    case OpcodeClass::BCC:
+                        condition = !flag_set(StatusFlag::Carry);
+                        break;
+                    case OpcodeClass::BCS:
+                        condition = flag_set(StatusFlag::Carry);
+                        break;
+                    case OpcodeClass::BEQ:
+                        condition = flag_set(StatusFlag::Zero);
+                        break;
+                    case OpcodeClass::BMI:
+                        condition = flag_set(StatusFlag::Negative);
+                        break;
+                    case OpcodeClass::BNE:
+                        condition = !flag_set(StatusFlag::Zero);
+                        break;
+                    case OpcodeClass::BPL:
+                        condition = !flag_set(StatusFlag::Negative);
+                        break;
+                    case OpcodeClass::BVC:
+                        condition = !flag_set(StatusFlag::Overflow);
+                        break;
+                    default:
+                        condition = flag_set(StatusFlag::Overflow);
+                        break;
+                }
+                if (!condition) {
+                    break;
+                }
+
+                co_await idle(); // Cycle 3 if branch taken
+
+                const word target = pc + offset;
+                if (target != non_page_crossing_add(pc, offset)) {
+                    co_await idle(); // Cycle 4 for page crossing
+                }
+                pc = target;
+                break;
+            }
+            case OpcodeClass::JMP:
+                pc = address;
+                break;
+            case OpcodeClass::JSR: {
+                const auto low = static_cast<word>(co_await fetch(pc++));
+
+                co_await read(stack(s)); // Dummy read cycle (3)
+
+                co_await write(stack(s--), static_cast<byte>(pc >> 8));
+                co_await write(stack(s--), static_cast<byte>(pc));
+
+                const auto high = static_cast<word>(co_await fetch(pc++));
+                pc = (high << 8) | low;
+                break;
+            }
+            case OpcodeClass::RTS: {
+                co_await read(pc); // Fetch next opcode and discard it
+                co_await read(stack(s++)); // Dummy read cycle (3)
+
+                const auto low = static_cast<word>(co_await read(stack(s++)));
+                const auto high = static_cast<word>(co_await read(stack(s)));
+                pc = (high << 8) | low;
+
+                co_await read(pc++);
+                break;
+            }
+            case OpcodeClass::RTI: {
+                co_await read(pc); // Fetch next opcode and discard it
+                co_await read(stack(s++)); // Dummy read cycle
+                const byte temp_p = co_await read(stack(s++));
+                // Bits 54 of the popped value from the stack should be ignored
+                p = (p & 0x30) | (temp_p & 0xCF);
+
+                const auto low = static_cast<word>(co_await read(stack(s++)));
+                const auto high = static_cast<word>(co_await read(stack(s)));
+                pc = (high << 8) | low;
+                break;
+            }
+            case OpcodeClass::BRK: {
+                co_await fetch(pc++);
+                co_await write(stack(s--), static_cast<byte>(pc >> 8));
+                co_await write(stack(s--), static_cast<byte>(pc));
+
+                // NMI can hijack BRK if it is pending here
+                const word vector =
+                    interrupts->nmi_pending ? Cpu<BusType>::NMI_VECTOR : Cpu<BusType>::IRQ_VECTOR;
+                // Ensure bits 45 are set before push
+                co_await write(stack(s--), p | static_cast<byte>(StatusFlag::B));
+                update_flag(StatusFlag::InterruptDisable, true);
+
+                const auto pcl = static_cast<word>(co_await read(vector));
+                const auto pch = static_cast<word>(co_await read(vector + 1));
+                pc = (pch << 8) | pcl;
+                break;
+            }
+            case OpcodeClass::PHA:
+                co_await read(pc); // Fetch next opcode and discard it
+                co_await write(stack(s--), a);
+                break;
+            case OpcodeClass::PHP:
+                co_await read(pc); // Fetch next opcode and discard it
+                // Ensure bits 45 are set before push
+                co_await write(stack(s--), p | static_cast<byte>(StatusFlag::B));
+                break;
+            case OpcodeClass::PLA:
+                co_await read(pc); // Fetch next opcode and discard it
+                co_await read(stack(s++)); // Dummy read cycle (3)
+                a = co_await read(stack(s));
+                update_zero_negative(a);
+                break;
+            case OpcodeClass::PLP: {
+                co_await read(pc); // Fetch next opcode and discard it
+                co_await read(stack(s++)); // Dummy read cycle (3)
+                const byte temp_p = co_await read(stack(s));
+                // Bits 54 of the popped value from the stack should be ignored
+                p = (p & 0x30) | (temp_p & 0xCF);
+                break;
+            }
+            case OpcodeClass::NOP:
+                if (mode != Mode::Implied) {
+                    co_await read(address);
+                } else {
+                    co_await idle();
+                }
+                break;
+            case OpcodeClass::JAM:
+                // These two reads are based on ProcessorTests
+                co_await read(pc);
+                co_await read(pc);
+                pc--; // The PC should not be incremented after a JAM opcode
+                jam_executed = true;
+                break;
+            case OpcodeClass::CLC:
+            case OpcodeClass::SEC:
+                update_flag(StatusFlag::Carry, opcode.opcode_class == OpcodeClass::SEC);
+                co_await idle();
+                break;
+            case OpcodeClass::CLD:
+            case OpcodeClass::SED:
+                update_flag(StatusFlag::Decimal, opcode.opcode_class == OpcodeClass::SED);
+                co_await idle();
+                break;
+            case OpcodeClass::CLI:
+            case OpcodeClass::SEI:
+                update_flag(StatusFlag::InterruptDisable, opcode.opcode_class == OpcodeClass::SEI);
+                co_await idle();
+                break;
+            case OpcodeClass::CLV:
+                update_flag(StatusFlag::Overflow, false);
+                co_await idle();
+                break;
+            case OpcodeClass::INX:
+                update_zero_negative(++x);
+                co_await idle();
+                break;
+            case OpcodeClass::INY:
+                update_zero_negative(++y);
+                co_await idle();
+                break;
+            case OpcodeClass::DEX:
+                update_zero_negative(--x);
+                co_await idle();
+                break;
+            case OpcodeClass::DEY:
+                update_zero_negative(--y);
+                co_await idle();
+                break;
+            case OpcodeClass::TAX:
+                x = a;
+                update_zero_negative(x);
+                co_await idle();
+                break;
+            case OpcodeClass::TAY:
+                y = a;
+                update_zero_negative(y);
+                co_await idle();
+                break;
+            case OpcodeClass::TSX:
+                x = s;
+                update_zero_negative(x);
+                co_await idle();
+                break;
+            case OpcodeClass::TXA:
+                a = x;
+                update_zero_negative(a);
+                co_await idle();
+                break;
+            case OpcodeClass::TXS:
+                s = x;
+                co_await idle();
+                break;
+            case OpcodeClass::TYA:
+                a = y;
+                update_zero_negative(a);
+                co_await idle();
+                break;
+            default:
+                spdlog::error("Unimplemented opcode {:#04X} found", opcode.opcode);
+                std::exit(-1);
+        }
+
+        if (idle_loops.is_enabled()) {
+            idle_loops.track(
+                opcode,
+                {
+                    .from = opcode_pc,
+                    .to = pc,
+                    .end_cycle = bus->cycles,
+                    .a = a,
+                    .x = x,
+                    .y = y,
+                    .s = s,
+                    .p = p,
+                },
+                [this](const word address) { return bus->cpu_read(address); }
+            );
+        }
+    }
+}
@@ -8,9 +8,12 @@
 #include <concepts>
 #include <cstdlib>
 #include <memory>
+#include <optional>
+#include <span>
 #include <tuple>
 
 #include "constants.hxx"
+#include "interrupts.hxx"
 
 #define OPCODE_CASE(opc) \
     case OpcodeClass::opc: \
@@ -31,6 +34,17 @@ concept SystemBus = requires(T bus, word address, byte data) {
     bus.cpu_write(address, data);
 };
 
+// Buses that expose the eight 4KB windows the cartridge maps over $8000-$FFFF, kept up to date as
+// it switches banks. The CPU fetches code from PRG-ROM through them without decoding the address
+template<typename T>
+concept PrgWindowedBus = requires(T bus) {
+    { bus.prg_windows() } -> std::convertible_to<std::span<const byte* const, 8>>;
+};
+
+// Start of the cartridge PRG-ROM window
+constexpr word PRG_ROM_START = 0x8000;
+constexpr word PRG_WINDOW_SIZE = 0x1000;
+
 enum class OpcodeClass : std::uint8_t {
     // Add Memory to Accumulator With Carry
     ADC,
@@ -184,6 +198,64 @@ class ExecutedOpcode {
     byte arg2{};
 };
 
+// A taken backward branch or jump, recorded to detect idle loops
+struct LoopIteration {
+    word from{};
+    word to{};
+    uint64_t end_cycle{};
+
+    byte a{}, x{}, y{}, s{}, p{};
+};
+
+// Longest loop body (in bytes, before the backward branch) considered for idle loop detection
+constexpr word MAX_IDLE_LOOP_LENGTH = 16;
+
+// Finds idle loops in the instructions a CPU executes. Shared by `Cpu` and `CoroutineCpu`
+class IdleLoopDetector {
+  private:
+    bool enabled{false};
+    std::optional<LoopIteration> last_iteration{};
+    uint64_t period{}; // CPU cycles per iteration of the current idle loop; 0 if none
+    bool polls_ppu{false};
+
+    template<typename CodeRead>
+    static bool is_idle_loop_body(word start, word end, bool& polls_ppu, CodeRead&& read);
+    static bool is_idle_loop_read(word address, bool& polls_ppu);
+
+  public:
+    void set_enabled(const bool enabled) {
+        this->enabled = enabled;
+        last_iteration.reset();
+        period = 0;
+    }
+
+    [[nodiscard]] bool is_enabled() const {
+        return enabled;
+    }
+
+    // Called after every instruction. `end_state` is what the CPU looks like once `opcode`,
+    // executed at `end_state.from`, is done. `read` reads memory without side effects
+    template<typename CodeRead>
+    void track(const Opcode& opcode, const LoopIteration& end_state, CodeRead&& read);
+
+    // An interrupt broke whatever loop the CPU was in
+    void interrupted() {
+        last_iteration.reset();
+    }
+
+    [[nodiscard]] uint64_t idle_loop_cycles() const {
+        return period;
+    }
+
+    [[nodiscard]] bool iteration_ended(const uint64_t cycles) const {
+        return last_iteration && last_iteration->end_cycle == cycles;
+    }
+
+    [[nodiscard]] bool idle_loop_polls_ppu_status() const {
+        return polls_ppu;
+    }
+};
+
 enum class StatusFlag : byte {
     Carry = (1U << 0U), // C
     Zero = (1U << 1U), // Z
@@ -204,10 +276,18 @@ class Cpu {
     byte p{0x34}; // Status register
 
     std::shared_ptr<BusType> bus{};
-    InterruptRequestFlag nmi_requested, irq_requested;
+    InterruptLines* interrupts{};
 
     boost::circular_buffer<ExecutedOpcode> executed_opcodes{30};
 
+    // The bus' PRG windows, code fetched from $8000-$FFFF is read straight out of them. Code
+    // running from RAM is always read through the bus
+    const byte* const* prg_windows{};
+
+    IdleLoopDetector idle_loops{};
+
+    bool jam_executed{false}; // The CPU has locked up on a JAM opcode
+
     // Addressing Modes
 
     // Takes 2 cycles
@@ -303,12 +383,13 @@ class Cpu {
 
     Cpu() = default;
 
-    Cpu(std::shared_ptr<BusType> bus,
-        InterruptRequestFlag nmi_requested,
-        InterruptRequestFlag irq_requested) :
+    Cpu(std::shared_ptr<BusType> bus, InterruptLines* interrupts) :
         bus{std::move(bus)},
-        nmi_requested{std::move(nmi_requested)},
-        irq_requested{std::move(irq_requested)} {}
+        interrupts{interrupts} {
+        if constexpr (PrgWindowedBus<BusType>) {
+            prg_windows = this->bus->prg_windows().data();
+        }
+    }
 
     [[nodiscard]] bool flag_set(StatusFlag flag) const {
         return (p & static_cast<byte>(flag)) != 0;
@@ -329,15 +410,74 @@ class Cpu {
         spdlog::error("CPU reset procedure not implemented");
     };
 
+    // Reads a byte of code without ticking the bus
+    byte code_read(const word address) {
+        if constexpr (PrgWindowedBus<BusType>) {
+            if (address >= PRG_ROM_START) {
+                return prg_windows[(address - PRG_ROM_START) / PRG_WINDOW_SIZE]
+                                  [address % PRG_WINDOW_SIZE];
+            }
+        }
+        return bus->cpu_read(address);
+    }
+
     byte fetch() {
-        return bus->ticked_cpu_read(pc++);
+        if constexpr (PrgWindowedBus<BusType>) {
+            bus->tick();
+            return code_read(pc++);
+        } else {
+            return bus->ticked_cpu_read(pc++);
+        }
     }
 
     void step();
     void execute_opcode(Opcode opcode);
 
+    void set_idle_loop_detection(const bool enabled) {
+        idle_loops.set_enabled(enabled);
+    }
+
+    // CPU cycles taken by each iteration of the idle loop the last `step()` completed an
+    // iteration of. 0 if the CPU is not in an idle loop. Repeating the iteration any number of
+    // times leaves the CPU exactly where it is, as long as nothing else changes the memory it reads
+    [[nodiscard]] uint64_t idle_loop_cycles() const {
+        return idle_loops.idle_loop_cycles();
+    }
+
+    // If the last `step()` jumped back to the start of a loop
+    [[nodiscard]] bool loop_iteration_ended() const {
+        return idle_loops.iteration_ended(bus->cycles);
+    }
+
+    // If the idle loop reads PPUSTATUS
+    [[nodiscard]] bool idle_loop_polls_ppu_status() const {
+        return idle_loops.idle_loop_polls_ppu_status();
+    }
+
+    [[nodiscard]] word program_counter() const {
+        return pc;
+    }
+
+    // Address of the instruction being executed, or of the last one between instructions
+    [[nodiscard]] word instruction_pc() const {
+        return executed_opcodes.empty() ? pc : executed_opcodes.back().pc;
+    }
+
+    // Heap memory the CPU allocates, the ring of executed opcodes. The `Cpu` itself lives inside
+    // whatever owns it and is not counted
+    [[nodiscard]] size_t memory_footprint() const {
+        return executed_opcodes.capacity() * sizeof(ExecutedOpcode);
+    }
+
+    // If a JAM opcode was executed. The CPU keeps executing it from then on
+    [[nodiscard]] bool jammed() const {
+        return jam_executed;
+    }
+
     // For setting random register state during opcode tests
     friend class Debugger;
+    // Loads and stores the registers of the lanes it steps with a `Cpu`
+    friend class BatchCpu;
 };
 
 inline word non_page_crossing_add(const word value, const word increment) {
@@ -637,49 +777,219 @@ void Cpu<BusType>::step() {
         .arg2 = 0x00,
     };
     if (opcode.length >= 2) {
-        executed_opcode.arg1 = bus->cpu_read(pc);
+        executed_opcode.arg1 = code_read(pc);
     }
     if (opcode.length >= 3) {
-        executed_opcode.arg2 = bus->cpu_read(pc + 1);
+        executed_opcode.arg2 = code_read(pc + 1);
     }
 
+    // Before executing it, so it is the current instruction for anything the execution triggers
+    executed_opcodes.push_back(executed_opcode);
+
     execute_opcode(opcode);
 
-    executed_opcodes.push_back(executed_opcode);
+    if (idle_loops.is_enabled()) {
+        idle_loops.track(
+            opcode,
+            {
+                .from = executed_opcode.pc,
+                .to = pc,
+                .end_cycle = bus->cycles,
+                .a = a,
+                .x = x,
+                .y = y,
+                .s = s,
+                .p = p,
+            },
+            [this](const word address) { return bus->cpu_read(address); }
+        );
+    }
+}
+
+template<typename CodeRead>
+void IdleLoopDetector::track(
+    const Opcode& opcode,
+    const LoopIteration& end_state,
+    CodeRead&& read
+) {
+    period = 0;
+
+    const bool jump = opcode.addressing_mode == AddressingMode::Relative || opcode.opcode == 0x4C;
+    if (!jump || end_state.to > end_state.from) {
+        return;
+    }
+
+    // The loop is idle if an iteration starts in the same state as the previous one and
+    // cannot change anything it reads
+    if (last_iteration && last_iteration->from == end_state.from
+        && last_iteration->to == end_state.to && last_iteration->a == end_state.a
+        && last_iteration->x == end_state.x && last_iteration->y == end_state.y
+        && last_iteration->s == end_state.s && last_iteration->p == end_state.p) {
+        bool loop_polls_ppu = false;
+        if (is_idle_loop_body(end_state.to, end_state.from, loop_polls_ppu, read)) {
+            period = end_state.end_cycle - last_iteration->end_cycle;
+            polls_ppu = loop_polls_ppu;
+        }
+    }
+
+    last_iteration = end_state;
+}
+
+template<typename CodeRead>
+bool IdleLoopDetector::is_idle_loop_body(
+    const word start,
+    const word end,
+    bool& polls_ppu,
+    CodeRead&& read
+) {
+    // Code outside RAM and the cartridge could have read side effects of its own
+    const auto is_code_address = [](const word address) {
+        return address < 0x2000 || address >= 0x6000;
+    };
+    if (end - start >= MAX_IDLE_LOOP_LENGTH || !is_code_address(start) || !is_code_address(end)) {
+        return false;
+    }
+
+    // The backward branch or jump at `end` has already been checked by the caller
+
+    word address = start;
+    while (address < end) {
+        const auto& opcode = OPCODES[read(address)];
+        const auto operand = opcode.length == 3
+            ? static_cast<word>(read(address + 1)) | static_cast<word>(read(address + 2)) << 8
+            : static_cast<word>(read(address + 1));
+
+        switch (opcode.opcode_class) {
+            case OpcodeClass::LDA:
+            case OpcodeClass::LDX:
+            case OpcodeClass::LDY:
+            case OpcodeClass::BIT:
+            case OpcodeClass::CMP:
+            case OpcodeClass::CPX:
+            case OpcodeClass::CPY:
+            case OpcodeClass::AND:
+            case OpcodeClass::ORA:
+            case OpcodeClass::EOR:
+            case OpcodeClass::ADC:
+            case OpcodeClass::SBC:
+            case OpcodeClass::NOP:
+                switch (opcode.addressing_mode) {
+                    case AddressingMode::Implied:
+                    case AddressingMode::Immediate:
+                    case AddressingMode::ZeroPage:
+                    case AddressingMode::ZeroPageX:
+                    case AddressingMode::ZeroPageY:
+                        break;
+                    case AddressingMode::Absolute:
+                        if (!is_idle_loop_read(operand, polls_ppu)) {
+                            return false;
+                        }
+                        break;
+                    case AddressingMode::AbsoluteXIndexed:
+                    case AddressingMode::AbsoluteYIndexed:
+                        // Only allow indexing within memory without read side effects
+                        if (operand >= 0x2000 - 0xFF && operand < 0x6000) {
+                            return false;
+                        }
+                        break;
+                    default:
+                        return false;
+                }
+                break;
+            case OpcodeClass::ASL:
+            case OpcodeClass::LSR:
+            case OpcodeClass::ROL:
+            case OpcodeClass::ROR:
+                if (opcode.addressing_mode != AddressingMode::Accumulator) {
+                    return false;
+                }
+                break;
+            case OpcodeClass::BCC:
+            case OpcodeClass::BCS:
+            case OpcodeClass::BEQ:
+            case OpcodeClass::BMI:
+            case OpcodeClass::BNE:
+            case OpcodeClass::BPL:
+            case OpcodeClass::BVC:
+            case OpcodeClass::BVS:
+            case OpcodeClass::CLC:
+            case OpcodeClass::SEC:
+            case OpcodeClass::CLV:
+            case OpcodeClass::CLD:
+            case OpcodeClass::SED:
+            case OpcodeClass::TAX:
+            case OpcodeClass::TAY:
+            case OpcodeClass::TXA:
+            case OpcodeClass::TYA:
+            case OpcodeClass::TSX:
+            case OpcodeClass::INX:
+            case OpcodeClass::INY:
+            case OpcodeClass::DEX:
+            case OpcodeClass::DEY:
+                break;
+            default:
+                return false;
+        }
+
+        address += opcode.length;
+    }
+
+    // The body must end exactly on the backward branch
+    return address == end;
+}
+
+inline bool IdleLoopDetector::is_idle_loop_read(const word address, bool& polls_ppu) {
+    if (address < 0x2000 || address >= 0x6000) {
+        // Internal RAM and cartridge space
+        return true;
+    }
+
+    if (address < 0x4000 && (address & 0b111) == 0x2) {
+        // PPUSTATUS only changes between reads because of the PPU
+        polls_ppu = true;
+        return true;
+    }
+
+    return false;
 }
 
 template<SystemBus BusType>
 void Cpu<BusType>::check_interrupts() {
-    if (*nmi_requested) {
-        *nmi_requested = false;
+    // The lines were polled during the last cycle of the previous instruction
+    const auto poll_cycle = bus->cycles;
+    if (interrupts->NmiPolled(poll_cycle)) {
+        interrupts->AcknowledgeNmi();
+        idle_loops.interrupted();
 
         bus->ticked_cpu_read(pc);
         bus->ticked_cpu_read(pc);
         bus->ticked_cpu_write(0x100 + s--, static_cast<byte>(pc >> 8));
         bus->ticked_cpu_write(0x100 + s--, static_cast<byte>(pc));
 
-        update_flag(StatusFlag::InterruptDisable, true);
         // Ensure the B flag is not set when pushing
         update_flag(StatusFlag::B, false);
         p |= (1 << 5); // The unused flag is set when pushing by NMI
         bus->ticked_cpu_write(0x100 + s--, p);
+        // Only after pushing, so RTI restores the I flag from before the interrupt
+        update_flag(StatusFlag::InterruptDisable, true);
 
         auto pcl = bus->ticked_cpu_read(NMI_VECTOR);
         auto pch = bus->ticked_cpu_read(NMI_VECTOR + 1);
         pc = (static_cast<word>(pch) << 8) | static_cast<word>(pcl);
-    } else if (!flag_set(StatusFlag::InterruptDisable) && *irq_requested) {
-        *irq_requested = false;
+    } else if (!flag_set(StatusFlag::InterruptDisable) && interrupts->IrqPolled(poll_cycle)) {
+        // IRQ stays asserted until its source releases it
+        idle_loops.interrupted();
 
         bus->ticked_cpu_read(pc);
         bus->ticked_cpu_read(pc);
         bus->ticked_cpu_write(0x100 + s--, static_cast<byte>(pc >> 8));
         bus->ticked_cpu_write(0x100 + s--, static_cast<byte>(pc));
 
-        update_flag(StatusFlag::InterruptDisable, true);
         // Ensure the B flag is not set when pushing
         update_flag(StatusFlag::B, false);
         p |= (1 << 5); // The unused flag is set when pushing by NMI
         bus->ticked_cpu_write(0x100 + s--, p);
+        update_flag(StatusFlag::InterruptDisable, true);
 
         auto pcl = bus->ticked_cpu_read(IRQ_VECTOR);
         auto pch = bus->ticked_cpu_read(IRQ_VECTOR + 1);
@@ -888,7 +1198,7 @@ void Cpu<BusType>::BRK(const Opcode&) {
     // NMI and IRQ can hijack BRK interrupt if they are pending here
     // TODO: Implement IRQ interrupt although it should not matter since both
     //       use the same vector
-    auto interrupt_vector = *nmi_requested ? NMI_VECTOR : IRQ_VECTOR;
+    auto interrupt_vector = interrupts->nmi_pending ? NMI_VECTOR : IRQ_VECTOR;
     byte temp_p = p | static_cast<byte>(StatusFlag::B); // Ensure bits 45 are set before push
     bus->ticked_cpu_write(0x100 + s--, temp_p);
     update_flag(StatusFlag::InterruptDisable, true);
@@ -966,6 +1276,7 @@ void Cpu<BusType>::JAM(const Opcode&) {
     bus->ticked_cpu_read(pc);
     bus->ticked_cpu_read(pc);
     pc--; // The PC should not be incremented after a JAM opcode
+    jam_executed = true;
 }
 
 template<SystemBus BusType>
@@ -6,8 +6,8 @@
 #include <cstdint>
 #include <iterator>
 #include <memory>
-#include <span>
 
+#include "batch_cpu.hxx"
 #include "constants.hxx"
 #include "cpu.hxx"
 #include "ppu.hxx"
@@ -46,9 +46,10 @@ struct PpuState {
     byte oamaddr;
 };
 
+// Both pattern tables as 128x128 images of 2-bit color indices, row by row
 struct PatternTablesState {
-    std::array<byte, 0x1000> left;
-    std::array<byte, 0x1000> right;
+    std::array<byte, 128 * 128> left;
+    std::array<byte, 128 * 128> right;
     std::array<byte, 0x20> palettes;
 };
 
@@ -66,15 +67,12 @@ class Debugger {
         emulator_context{std::move(emulator_context)} {
     }
 
-    [[nodiscard]] std::span<word, NES_WIDTH * NES_HEIGHT> Framebuffer() const {
-        return std::span<word, NES_WIDTH * NES_HEIGHT>{
-            emulator_context->ppu->framebuffer.data(),
-            NES_WIDTH * NES_HEIGHT
-        };
+    [[nodiscard]] PpuFramebuffer& Framebuffer() const {
+        return emulator_context->ppu->Framebuffer();
     }
 
-    template<typename BusType>
-    static CpuState GetCpuState(Cpu<BusType>& cpu) {
+    template<typename CpuType>
+    static CpuState GetCpuState(CpuType& cpu) {
         return CpuState{
             .a = cpu.a,
             .x = cpu.x,
@@ -89,10 +87,30 @@ class Debugger {
         return GetCpuState(this->emulator_context->cpu);
     }
 
+    static CpuState GetCpuState(BatchCpu& cpu, const size_t lane) {
+        return CpuState{
+            .a = cpu.a[lane],
+            .x = cpu.x[lane],
+            .y = cpu.y[lane],
+            .s = cpu.s[lane],
+            .pc = cpu.pc[lane],
+            .p = cpu.p[lane],
+        };
+    }
+
+    [[nodiscard]] static PpuFramebuffer& Framebuffer(const BatchCpu& cpu, const size_t lane) {
+        return cpu.ppus[lane]->Framebuffer();
+    }
+
     [[nodiscard]] CpuState GetCpuState() const {
         return GetCpuState(this->emulator_context->cpu);
     }
 
+    // CPU cycles run since startup
+    [[nodiscard]] uint64_t CpuCycles() const {
+        return emulator_context->bus->cycles;
+    }
+
     void load_cpu_opcodes(std::vector<ExecutedOpcode>& executed_opcodes) const {
         const auto& cpu_opcodes = emulator_context->cpu.executed_opcodes;
         executed_opcodes.clear();
@@ -129,8 +147,8 @@ class Debugger {
         ppu_state.frame_count = ppu->frame_count;
         ppu_state.scanline = ppu->scanline;
         ppu_state.line_cycles = ppu->line_cycles;
-        ppu_state.v = ppu->v.value;
-        ppu_state.t = ppu->t.value;
+        ppu_state.v = ppu->v;
+        ppu_state.t = ppu->t;
         ppu_state.ppuctrl = ppu->ppuctrl;
         ppu_state.ppumask = ppu->ppumask;
         ppu_state.ppustatus = ppu->ppustatus;
@@ -141,9 +159,19 @@ class Debugger {
         const auto& cart = emulator_context->bus->cartridge;
         const auto& palette_table = emulator_context->ppu->palette_table;
 
-        for (size_t i = 0; i < 0x1000; i++) {
-            pattern_tables_state.left.at(i) = cart->ppu_read(i);
-            pattern_tables_state.right.at(i) = cart->ppu_read(0x1000 + i);
+        // 16x16 tiles per table, taken from the same decoded rows the PPU renders with
+        for (word tile = 0; tile < 256; tile++) {
+            for (word fine_y = 0; fine_y < 8; fine_y++) {
+                const size_t pixel_index = ((tile / 16) * 8 + fine_y) * 128 + (tile % 16) * 8;
+                std::ranges::copy(
+                    cart->ppu_tile_row((tile << 4) + fine_y).pixels,
+                    pattern_tables_state.left.begin() + pixel_index
+                );
+                std::ranges::copy(
+                    cart->ppu_tile_row(0x1000 + (tile << 4) + fine_y).pixels,
+                    pattern_tables_state.right.begin() + pixel_index
+                );
+            }
         }
 
         for (size_t i = 0; i < 32; i++) {
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "cartridge.hxx"
+#include "constants.hxx"
+
+// Discrete-logic boards only latch whatever the CPU writes to $8000-$FFFF and feed some of its
+// bits to the bank address lines. Those are described by a `MapperSpec` instead of being written
+// out by hand, and `DeclarativeMapper` turns the description into the register decoding and bank
+// mapping at compile time. Boards with shift registers, scanline counters or PPU latches (MMC1-5,
+// VRC) don't fit the description and stay hand-written
+
+// A register written at every CPU address where `(address & mask) == match`
+struct RegisterDecode {
+    word mask{};
+    word match{};
+};
+
+enum class BankSource : uint8_t {
+    Fixed, // Always the bank in `value`
+    Last, // The last bank of its size
+    Register, // Bits `shift` on of register `value`, `mask`ed
+};
+
+// A range of the address space and the bank mapped there. Banks are numbered in units of `size`,
+// a `size` of 0 leaves the slot unused
+struct BankSlot {
+    word address{};
+    word size{};
+    BankSource source{BankSource::Fixed};
+    byte value{};
+    byte shift{};
+    byte mask{0xFF};
+};
+
+enum class MirroringSource : uint8_t {
+    Hardwired, // Soldered on the board, what the header says
+    SingleScreen, // Register bit picks the lower or upper 1KB of VRAM
+    VerticalHorizontal, // Register bit picks vertical (0) or horizontal (1)
+};
+
+struct MirroringControl {
+    MirroringSource source{MirroringSource::Hardwired};
+    byte register_index{};
+    byte bit{};
+};
+
+struct MapperSpec {
+    std::array<RegisterDecode, 2> registers{};
+    size_t register_count{};
+    std::array<BankSlot, 2> prg{};
+    std::array<BankSlot, 2> chr{};
+    MirroringControl mirroring{};
+    // The ROM drives the data bus during register writes too, so the latch sees the written value
+    // ANDed with the byte at the address
+    bool bus_conflicts{};
+};
+
+template<MapperSpec Spec>
+class DeclarativeMapper final: public Cartridge {
+  public:
+    explicit DeclarativeMapper(std::shared_ptr<const RomImage> image) :
+        Cartridge(std::move(image)) {
+        map_banks();
+    }
+
+    [[nodiscard]] Mirroring mirroring() const override {
+        const byte control = registers[Spec.mirroring.register_index];
+        const bool bit = ((control >> Spec.mirroring.bit) & 1U) != 0;
+        if constexpr (Spec.mirroring.source == MirroringSource::SingleScreen) {
+            return bit ? Mirroring::SingleScreenUpper : Mirroring::SingleScreenLower;
+        } else if constexpr (Spec.mirroring.source == MirroringSource::VerticalHorizontal) {
+            return bit ? Mirroring::Horizontal : Mirroring::Vertical;
+        } else {
+            return header.hardware_mirroring;
+        }
+    }
+
+    friend class Debugger;
+
+  private:
+    std::array<byte, Spec.registers.size()> registers{};
+
+    void register_write(uint64_t, const word address, byte data) override {
+        // Register writes are all at $8000-$FFFF, the conflicting byte is always in a PRG window
+        if constexpr (Spec.bus_conflicts) {
+            data &= prg_windows[(address - 0x8000) / PRG_WINDOW_SIZE][address % PRG_WINDOW_SIZE];
+        }
+
+        if constexpr (Spec.mirroring.source == MirroringSource::Hardwired) {
+            if (latch(address, data)) {
+                map_banks();
+            }
+        } else {
+            const auto previous_mirroring = mirroring();
+            if (!latch(address, data)) {
+                return;
+            }
+            map_banks();
+            if (mirroring() != previous_mirroring) {
+                mirroring_generation++;
+            }
+        }
+    }
+
+    // Stores `data` in the registers decoded at `address`, whether any of them changed
+    bool latch(const word address, const byte data) {
+        bool changed = false;
+        for (size_t i = 0; i < Spec.register_count; i++) {
+            // A15 is always set here, so decoding it alone folds away
+            if (((address | 0x8000U) & Spec.registers[i].mask) == Spec.registers[i].match) {
+                changed |= std::exchange(registers[i], data) != data;
+            }
+        }
+        return changed;
+    }
+
+    [[nodiscard]] size_t bank(const BankSlot& slot, const size_t memory_size) const {
+        switch (slot.source) {
+            case BankSource::Fixed:
+                return slot.value;
+            case BankSource::Last:
+                return memory_size / slot.size - 1;
+            case BankSource::Register:
+                return (registers[slot.value] >> slot.shift) & slot.mask;
+        }
+        return 0;
+    }
+
+    // `Spec` is a constant, so these loops and the switch in `bank()` fold away into the handful
+    // of `map_prg()`/`map_chr()` calls of the board
+    void map_banks() {
+        for (const auto& slot : Spec.prg) {
+            if (slot.size != 0) {
+                map_prg(slot.address, slot.size, bank(slot, prg_rom.size()) * slot.size);
+            }
+        }
+        for (const auto& slot : Spec.chr) {
+            if (slot.size != 0) {
+                map_chr(slot.address, slot.size, bank(slot, chr.size()) * slot.size);
+            }
+        }
+    }
+};
+
+// Any write to $8000-$FFFF
+constexpr RegisterDecode WHOLE_ROM{.mask = 0x8000, .match = 0x8000};
+
+// Mapper 2
+// Switchable 16KB at $8000, last 16KB fixed at $C000, CHR-RAM usually
+constexpr MapperSpec UXROM{
+    .registers = {WHOLE_ROM},
+    .register_count = 1,
+    .prg =
+        {BankSlot{.address = 0x8000, .size = 0x4000, .source = BankSource::Register, .mask = 0x0F},
+         BankSlot{.address = 0xC000, .size = 0x4000, .source = BankSource::Last}},
+    .chr = {BankSlot{.address = 0x0000, .size = 0x2000}},
+    .bus_conflicts = true,
+};
+
+// Mapper 3
+// Fixed 32KB of PRG-ROM and switchable 8KB of CHR-ROM
+constexpr MapperSpec CNROM{
+    .registers = {WHOLE_ROM},
+    .register_count = 1,
+    .prg = {BankSlot{.address = 0x8000, .size = 0x8000}},
+    .chr =
+        {BankSlot{.address = 0x0000, .size = 0x2000, .source = BankSource::Register, .mask = 0x03}
+        },
+    .bus_conflicts = true,
+};
+
+// Mapper 7
+// Switchable 32KB of PRG-ROM, bit 4 picks the single nametable all four show
+constexpr MapperSpec AXROM{
+    .registers = {WHOLE_ROM},
+    .register_count = 1,
+    .prg =
+        {BankSlot{.address = 0x8000, .size = 0x8000, .source = BankSource::Register, .mask = 0x07}
+        },
+    .chr = {BankSlot{.address = 0x0000, .size = 0x2000}},
+    .mirroring = {.source = MirroringSource::SingleScreen, .bit = 4},
+};
+
+// Mapper 11
+// 32KB PRG-ROM bank in the low bits, 8KB CHR-ROM bank in the high ones
+constexpr MapperSpec COLOR_DREAMS{
+    .registers = {WHOLE_ROM},
+    .register_count = 1,
+    .prg =
+        {BankSlot{.address = 0x8000, .size = 0x8000, .source = BankSource::Register, .mask = 0x03}
+        },
+    .chr = {BankSlot{
+        .address = 0x0000,
+        .size = 0x2000,
+        .source = BankSource::Register,
+        .shift = 4,
+        .mask = 0x0F,
+    }},
+    .bus_conflicts = true,
+};
+
+// Mapper 66
+// The other way around from Color Dreams
+constexpr MapperSpec GXROM{
+    .registers = {WHOLE_ROM},
+    .register_count = 1,
+    .prg = {BankSlot{
+        .address = 0x8000,
+        .size = 0x8000,
+        .source = BankSource::Register,
+        .shift = 4,
+        .mask = 0x03,
+    }},
+    .chr =
+        {BankSlot{.address = 0x0000, .size = 0x2000, .source = BankSource::Register, .mask = 0x03}
+        },
+    .bus_conflicts = true,
+};
+
+// Mapper 71
+// UxROM without bus conflicts, the bank register is only at $C000-$FFFF
+constexpr MapperSpec CAMERICA{
+    .registers = {RegisterDecode{.mask = 0xC000, .match = 0xC000}},
+    .register_count = 1,
+    .prg =
+        {BankSlot{.address = 0x8000, .size = 0x4000, .source = BankSource::Register, .mask = 0x0F},
+         BankSlot{.address = 0xC000, .size = 0x4000, .source = BankSource::Last}},
+    .chr = {BankSlot{.address = 0x0000, .size = 0x2000}},
+};
+
+// Mapper 71, submapper 1
+// The Fire Hawk board also picks its single nametable with bit 4 of $9000-$9FFF
+constexpr MapperSpec FIRE_HAWK{
+    .registers =
+        {RegisterDecode{.mask = 0xC000, .match = 0xC000},
+         RegisterDecode{.mask = 0xF000, .match = 0x9000}},
+    .register_count = 2,
+    .prg = CAMERICA.prg,
+    .chr = CAMERICA.chr,
+    .mirroring = {.source = MirroringSource::SingleScreen, .register_index = 1, .bit = 4},
+};
+
+using Uxrom = DeclarativeMapper<UXROM>;
+using Cnrom = DeclarativeMapper<CNROM>;
+using Axrom = DeclarativeMapper<AXROM>;
+using ColorDreams = DeclarativeMapper<COLOR_DREAMS>;
+using Gxrom = DeclarativeMapper<GXROM>;
+using Camerica = DeclarativeMapper<CAMERICA>;
+using FireHawk = DeclarativeMapper<FIRE_HAWK>;
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+#include "constants.hxx"
+
+class PpuEventLog;
+
+enum class IrqSource : byte {
+    FrameCounter = (1U << 0U),
+    Dmc = (1U << 1U),
+    Mapper = (1U << 2U),
+};
+
+// The NMI and IRQ inputs of the CPU. NMI is edge triggered and stays pending until the CPU
+// services it. IRQ is level triggered and stays asserted for as long as any source holds it.
+// Both remember the CPU cycle they were asserted on since the CPU only polls them during the
+// second-to-last cycle of an instruction
+struct InterruptLines {
+    bool nmi_pending{false};
+    uint64_t nmi_cycle{};
+
+    byte irq_sources{};
+    uint64_t irq_cycle{};
+
+    PpuEventLog* event_log{}; // Records interrupts as they are raised while set
+
+    void RaiseNmi(const uint64_t cycle) {
+        if (!nmi_pending) {
+            nmi_pending = true;
+            nmi_cycle = cycle;
+            if (event_log != nullptr) {
+                RecordNmi();
+            }
+        }
+    }
+
+    void AcknowledgeNmi() {
+        nmi_pending = false;
+    }
+
+    void AssertIrq(const IrqSource source, const uint64_t cycle) {
+        if (irq_sources == 0) {
+            irq_cycle = cycle;
+        }
+        if (event_log != nullptr && !IrqAsserted(source)) {
+            RecordIrq(source);
+        }
+        irq_sources |= static_cast<byte>(source);
+    }
+
+    void ReleaseIrq(const IrqSource source) {
+        irq_sources &= ~static_cast<byte>(source);
+    }
+
+    [[nodiscard]] bool IrqAsserted() const {
+        return irq_sources != 0;
+    }
+
+    [[nodiscard]] bool IrqAsserted(const IrqSource source) const {
+        return (irq_sources & static_cast<byte>(source)) != 0;
+    }
+
+    // Whether the CPU sees the lines when polling at the start of the instruction that begins
+    // after `cycle`. Anything asserted during that last cycle is only seen one instruction later
+    [[nodiscard]] bool NmiPolled(const uint64_t cycle) const {
+        return nmi_pending && nmi_cycle < cycle;
+    }
+
+    [[nodiscard]] bool IrqPolled(const uint64_t cycle) const {
+        return irq_sources != 0 && irq_cycle < cycle;
+    }
+
+  private:
+    // Out of line so only the event log's own code needs to know what it looks like
+    void RecordNmi() const;
+    void RecordIrq(IrqSource source) const;
+};
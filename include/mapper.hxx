@@ -2,6 +2,7 @@
 
 #include <spdlog/spdlog.h>
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
@@ -13,122 +14,43 @@
 #include "constants.hxx"
 #include "util.hxx"
 
-std::shared_ptr<Cartridge>
-init_mapper(RomHeader header, std::vector<byte>&& prg_rom, std::vector<byte>&& chr_rom);
+// The mapper the image's header asks for, with its banks mapped from `image`
+std::shared_ptr<Cartridge> init_mapper(std::shared_ptr<const RomImage> image);
 
 // Mapper 0
 // Most basic with no switchable PRG ROM with 16KB and 32KB sizes
-// and no CHR ROM banking and 8KB fixed size
+// and no CHR ROM banking and 8KB fixed size. The default windows are all it needs, 16KB of
+// PRG-ROM simply shows up twice
 class Nrom final: public Cartridge {
   public:
-    explicit Nrom(
-        const RomHeader& header,
-        std::vector<byte>&& prg_rom,
-        std::vector<byte>&& chr_rom
-    ) :
-        Cartridge(header),
-        prg_rom{std::move(prg_rom)},
-        chr_rom{std::move(chr_rom)} {}
-
-    byte cpu_read([[maybe_unused]] uint64_t cpu_cycle, const word address) override {
-        return prg_rom[map_cpu_addr(address)];
-    }
-
-    void cpu_write(uint64_t, word, byte) override {}
-
-    byte ppu_read(const word address) override {
-        return chr_rom[address];
-    }
-
-    void ppu_write(word, byte) override {}
+    explicit Nrom(std::shared_ptr<const RomImage> image) :
+        Cartridge(std::move(image)) {}
 
     friend class Debugger;
 
   private:
-    std::vector<byte> prg_rom, chr_rom;
-
-    [[nodiscard]] word map_cpu_addr(word address) const {
-        if (InRange<word>(0x8000, address, 0xFFFF)) {
-            return address % (16384 * header.prg_rom_banks);
-        }
-
-        spdlog::error("Unknown CPU address {:#06X} to NROM", address);
-        return 0x0000;
-    }
+    void register_write(uint64_t, word, byte) override {}
 };
 
 using Mmc1Register = SizedBitField<byte, 5>;
 
 class Mmc1 final: public Cartridge {
   public:
-    explicit Mmc1(
-        const RomHeader& header,
-        std::vector<byte>&& prg_rom,
-        std::vector<byte>&& chr_rom
-    ) :
-        Cartridge(header),
-        prg_rom(std::move(prg_rom)),
-        chr_rom(std::move(chr_rom)) {
-        if (header.chr_rom_size
-            == 0x00) { // iNES format only!! Size 0 indicates CHR-RAM is being used
-            this->chr_rom = std::vector<byte>(0x2000, 0);
-        }
-
+    explicit Mmc1(std::shared_ptr<const RomImage> image) :
+        Cartridge(std::move(image)) {
         if (header.prg_ram_size) {
             spdlog::info("Initializing PRG RAM of size 0x2000");
-            prg_ram = std::make_optional<std::vector<byte>>(0x8000U - 0x6000U, 0);
+            prg_ram.resize(0x8000U - 0x6000U, 0);
         }
-    }
-
-    byte cpu_read([[maybe_unused]] uint64_t cpu_cycle, word address) override {
-        if (InRange<word>(0x6000, address, 0x7FFF) && prg_ram) {
-            return prg_ram->at(address - 0x6000U);
-        }
-
-        if (InRange<word>(0x8000, address, 0xFFFF)) {
-            return prg_rom[map_cpu_addr(address)];
-        }
-
-        spdlog::debug("Unexpected address to MMC1::cpu_read {:#06X}", address);
-        return 0x00;
-    }
-
-    void cpu_write(const uint64_t cpu_cycle, const word address, const byte data) override {
-        if (InRange<word>(0x6000, address, 0x7FFF) && prg_ram) {
-            prg_ram->at(address - 0x6000U) = data;
-            return;
-        }
-
-        if (InRange<word>(0x8000, address, 0xFFFF)) {
-            register_write(cpu_cycle, address, data);
-            return;
-        }
-
-        spdlog::debug("Unexpected address to MMC1::cpu_write {:#06X}", address);
-    }
-
-    byte ppu_read(word address) override {
-        if (InRange<word>(0x0000, address, 0x1FFF)) {
-            return chr_rom[map_ppu_addr(address)];
-        }
-        spdlog::debug("Unexpected address to MMC1::ppu_read {:#06X}", address);
-        return 0x00;
-    }
-
-    void ppu_write(word address, const byte data) override {
-        if (InRange<word>(0x0000, address, 0x1FFF)) {
-            chr_rom[map_ppu_addr(address)] = data;
-            return;
-        }
-        spdlog::debug("Unexpected address to MMC1::ppu_write {:#06X}", address);
+        map_banks();
     }
 
     [[nodiscard]] Mirroring mirroring() const override {
         switch (control.value & 0b11U) {
             case 0:
-                break;
+                return Mirroring::SingleScreenLower;
             case 1:
-                break;
+                return Mirroring::SingleScreenUpper;
             case 2:
                 return Mirroring::Vertical;
             case 3:
@@ -141,9 +63,6 @@ class Mmc1 final: public Cartridge {
     }
 
   private:
-    std::vector<byte> prg_rom, chr_rom;
-    std::optional<std::vector<byte>> prg_ram{};
-
     uint64_t last_cpu_write_cycle{};
 
     Mmc1Register control{0x0C}, chr_bank_0{}, chr_bank_1{}, prg_bank{0x10};
@@ -151,7 +70,7 @@ class Mmc1 final: public Cartridge {
 
     byte shift_reg_write_cnt{0};
 
-    void register_write(const uint64_t cpu_cycle, const word address, const byte data) {
+    void register_write(const uint64_t cpu_cycle, const word address, const byte data) override {
         if ((last_cpu_write_cycle - cpu_cycle) < 2) {
             last_cpu_write_cycle = cpu_cycle;
             return;
@@ -163,68 +82,186 @@ class Mmc1 final: public Cartridge {
 
             control.value = 0x0C;
             prg_bank.value = 0x10;
+            mirroring_generation++;
         } else {
             shift_reg_write_cnt++;
             shift_reg.value = ((data & 0b1U) << 4U) | (shift_reg.value >> 1U);
-            if (shift_reg_write_cnt == 5) {
-                shift_reg_write_cnt = 0;
-                switch ((address & 0x6000U) >> 13U) {
-                    case 0b00:
-                        control.value = shift_reg.value;
-                        break;
-                    case 0b01:
-                        chr_bank_0.value = shift_reg.value;
-                        break;
-                    case 0b10:
-                        chr_bank_1.value = shift_reg.value;
-                        break;
-                    case 0b11:
-                        prg_bank.value = shift_reg.value;
-                        break;
-                    default:
-                        break;
-                }
-                shift_reg.value = 0x00;
+            if (shift_reg_write_cnt != 5) {
+                return;
+            }
+
+            shift_reg_write_cnt = 0;
+            switch ((address & 0x6000U) >> 13U) {
+                case 0b00:
+                    control.value = shift_reg.value;
+                    mirroring_generation++;
+                    break;
+                case 0b01:
+                    chr_bank_0.value = shift_reg.value;
+                    break;
+                case 0b10:
+                    chr_bank_1.value = shift_reg.value;
+                    break;
+                case 0b11:
+                    prg_bank.value = shift_reg.value;
+                    break;
+                default:
+                    break;
             }
+            shift_reg.value = 0x00;
         }
+        map_banks();
     }
 
-    [[nodiscard]] size_t map_cpu_addr(const word address) const {
+    void map_banks() {
+        // PRG banks are numbered in 16KB, CHR banks in 4KB
         switch ((control.value & 0x0CU) >> 2U) {
             case 0b00:
             case 0b01:
                 // Switching whole 32KB -> Ignore low bit of bank number
-                return ((prg_bank.value & 0xEU) * 32768) + (address - 0x8000);
+                map_prg(0x8000, 0x8000, (prg_bank.value & 0xEU) * 0x4000);
+                break;
+            case 0b10:
+                // Fixed first bank, switchable 16KB mapped to 0xC000-0xFFFF
+                map_prg(0x8000, 0x4000, 0);
+                map_prg(0xC000, 0x4000, (prg_bank.value & 0xFU) * 0x4000);
+                break;
+            case 0b11:
+                // Switchable first bank, fixed last bank
+                map_prg(0x8000, 0x4000, (prg_bank.value & 0xFU) * 0x4000);
+                map_prg(0xC000, 0x4000, prg_rom.size() - 0x4000);
+                break;
+            default:
+                break;
+        }
+
+        if ((control.value & 0x10U) == 0x10U) {
+            // 4KB individual bank mode
+            map_chr(0x0000, 0x1000, chr_bank_0.value * 0x1000);
+            map_chr(0x1000, 0x1000, chr_bank_1.value * 0x1000);
+        } else {
+            // 8KB whole bank mode
+            map_chr(0x0000, 0x2000, (chr_bank_0.value & 0x1EU) * 0x1000);
+        }
+    }
+};
+
+// Mapper 4
+// Eight bank registers loaded through $8000/$8001: two 2KB and four 1KB CHR banks and two 8KB
+// PRG banks, with the second to last and last 8KB of PRG-ROM fixed around them. A scanline
+// counter clocked by rises of PPU A12 asserts IRQ when it reaches 0
+class Mmc3 final: public Cartridge {
+  public:
+    explicit Mmc3(std::shared_ptr<const RomImage> image) :
+        Cartridge(std::move(image)) {
+        // Nearly every MMC3 board has it, iNES headers often leave it out
+        prg_ram.resize(0x8000U - 0x6000U, 0);
+        watches_a12 = true;
+        map_banks();
+    }
+
+    [[nodiscard]] Mirroring mirroring() const override {
+        if (header.hardware_mirroring == Mirroring::FourScreenVram) {
+            return Mirroring::FourScreenVram;
+        }
+        return (mirroring_control & 0b1U) != 0 ? Mirroring::Horizontal : Mirroring::Vertical;
+    }
+
+    void ppu_a12_rise(const uint64_t cpu_cycle) override {
+        if (irq_counter == 0 || irq_reload) {
+            irq_counter = irq_latch;
+            irq_reload = false;
+        } else {
+            irq_counter--;
+        }
+
+        if (irq_counter == 0 && irq_enabled) {
+            interrupts->AssertIrq(IrqSource::Mapper, cpu_cycle);
+        }
+    }
+
+    [[nodiscard]] std::optional<unsigned int> a12_rises_until_irq() const override {
+        if (!irq_enabled) {
+            return std::nullopt;
+        }
+        if (irq_counter == 0 || irq_reload) {
+            // Reloaded on the next rise, a latch of 0 asserts on every one
+            return irq_latch + 1U;
+        }
+        return irq_counter;
+    }
+
+    friend class Debugger;
+
+  private:
+    byte bank_select{};
+    std::array<byte, 8> banks{0, 2, 4, 5, 6, 7, 0, 1};
+    byte mirroring_control{};
+
+    byte irq_latch{};
+    byte irq_counter{};
+    bool irq_reload{false};
+    bool irq_enabled{false};
+
+    void register_write(uint64_t, const word address, const byte data) override {
+        const bool odd = (address & 0b1U) != 0;
+        switch ((address & 0x6000U) >> 13U) {
+            case 0b00:
+                if (odd) {
+                    banks[bank_select & 0b111U] = data;
+                } else {
+                    bank_select = data;
+                }
+                map_banks();
+                break;
+            case 0b01:
+                if (odd) {
+                    // Bit 7 enables the PRG-RAM, bit 6 protects it from writes
+                    prg_ram_enabled = (data & 0x80U) != 0;
+                    prg_ram_writable = prg_ram_enabled && (data & 0x40U) == 0;
+                } else if (mirroring_control != data) {
+                    mirroring_control = data;
+                    mirroring_generation++;
+                }
+                break;
             case 0b10:
-                if (InRange<word>(0x8000U, address, 0xBFFFU)) {
-                    // Fixed first bank
-                    return address - 0x8000U;
+                if (odd) {
+                    irq_counter = 0;
+                    irq_reload = true;
+                } else {
+                    irq_latch = data;
                 }
-                // Switchable 16KB mapped to 0xC000-0xFFFF
-                return ((prg_bank.value & 0xFU) * 16384) + (address - 0xC000U);
+                break;
             case 0b11:
-                if (InRange<word>(0x8000U, address, 0xBFFFU)) {
-                    // Switchable first bank
-                    return ((prg_bank.value & 0xFU) * 16384) + (address - 0x8000U);
+                irq_enabled = odd;
+                if (!odd) {
+                    interrupts->ReleaseIrq(IrqSource::Mapper);
                 }
-                // Fixed last bank
-                return ((header.prg_rom_banks - 1) * 16384) + (address - 0xC000U);
+                break;
             default:
                 break;
         }
-
-        return address;
     }
 
-    [[nodiscard]] size_t map_ppu_addr(const word address) const {
-        if ((control.value & 0x10U) == 0x10U) {
-            // 4KB individual bank mode
-            if (InRange<word>(0x0000, address, 0x0FFF)) {
-                return (chr_bank_0.value * 4096U) + address;
-            }
-            return (chr_bank_1.value * 4096U) + (address - 0x1000);
+    void map_banks() {
+        // PRG banks are numbered in 8KB, CHR banks in 1KB
+        const size_t second_last = prg_rom.size() - 0x4000;
+        if ((bank_select & 0x40U) != 0) {
+            map_prg(0x8000, 0x2000, second_last);
+            map_prg(0xC000, 0x2000, banks[6] * 0x2000);
+        } else {
+            map_prg(0x8000, 0x2000, banks[6] * 0x2000);
+            map_prg(0xC000, 0x2000, second_last);
+        }
+        map_prg(0xA000, 0x2000, banks[7] * 0x2000);
+        map_prg(0xE000, 0x2000, prg_rom.size() - 0x2000);
+
+        // The 2KB banks swap places with the 1KB ones when bit 7 is set
+        const word inverted = (bank_select & 0x80U) != 0 ? 0x1000 : 0x0000;
+        map_chr(0x0000 ^ inverted, 0x0800, (banks[0] & 0xFEU) * 0x400);
+        map_chr(0x0800 ^ inverted, 0x0800, (banks[1] & 0xFEU) * 0x400);
+        for (size_t i = 0; i < 4; i++) {
+            map_chr((0x1000 + i * 0x400) ^ inverted, 0x400, banks[2 + i] * 0x400);
         }
-        // 8KB whole bank mode
-        return ((chr_bank_0.value & 0x1EU) * 8192U) + address;
     }
 };
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "constants.hxx"
+#include "ppu.hxx"
+
+// Observations of the console for agents that look at it rather than a screen, taken once a
+// frame is done. Each writes into a buffer the caller provides and never allocates
+
+// `framebuffer` in grayscale, scaled down to `width` x `height` by averaging all the pixels each
+// output pixel covers. `luma` is row-major and holds at least `width * height` bytes. Emphasis is
+// ignored
+void DownsampleLuma(
+    const PpuFramebuffer& framebuffer,
+    std::span<byte> luma,
+    size_t width,
+    size_t height
+);
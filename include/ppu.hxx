@@ -2,13 +2,20 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <array>
+#include <bitset>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <span>
+#include <utility>
+#include <vector>
 
 #include "cartridge.hxx"
 #include "constants.hxx"
+#include "interrupts.hxx"
 
 struct Sprite {
     byte y;
@@ -33,17 +40,113 @@ struct Sprite {
     }
 };
 
+// What the PPU outputs: one palette color (0-63) per pixel and the color emphasis bits of PPUMASK
+// once per line, taken when the line was last drawn to. Lines whose pixels or emphasis change are
+// marked dirty until `TakeDirtyLines()`, so consumers can skip the rest
+struct PpuFramebuffer {
+    std::array<byte, NES_WIDTH * NES_HEIGHT> pixels{};
+    std::array<byte, NES_HEIGHT> emphasis{};
+    // One flag per line rather than a bitset since the output threads mark their lines at once
+    std::array<bool, NES_HEIGHT> dirty = [] {
+        std::array<bool, NES_HEIGHT> lines{};
+        lines.fill(true);
+        return lines;
+    }();
+
+    [[nodiscard]] std::span<const byte, NES_WIDTH> Line(const size_t y) const {
+        return std::span<const byte, NES_WIDTH>{pixels.data() + y * NES_WIDTH, NES_WIDTH};
+    }
+
+    void SetPixel(const size_t x, const size_t y, const byte color, const byte line_emphasis) {
+        auto& pixel = pixels[y * NES_WIDTH + x];
+        dirty[y] = dirty[y] || pixel != color || emphasis[y] != line_emphasis;
+        pixel = color;
+        emphasis[y] = line_emphasis;
+    }
+
+    void
+    SetLine(const size_t y, std::span<const byte, NES_WIDTH> colors, const byte line_emphasis) {
+        auto* line = pixels.data() + y * NES_WIDTH;
+        if (emphasis[y] != line_emphasis || !std::ranges::equal(colors, Line(y))) {
+            std::ranges::copy(colors, line);
+            emphasis[y] = line_emphasis;
+            dirty[y] = true;
+        }
+    }
+
+    // Lines changed since the last call
+    std::bitset<NES_HEIGHT> TakeDirtyLines() {
+        std::bitset<NES_HEIGHT> lines;
+        for (size_t y = 0; y < dirty.size(); y++) {
+            lines[y] = dirty[y];
+        }
+        dirty.fill(false);
+        return lines;
+    }
+};
+
+// What the sprites put on one pixel of a line
+struct SpritePixel {
+    byte palette_address; // Of the frontmost opaque sprite pixel, 0 if there is none
+    bool behind_background;
+    bool sprite_zero; // Sprite 0 is opaque here
+};
+
+// Everything the output of a visible line depends on once its background and sprites are known,
+// handed to the output thread by the scanline renderer
+struct PpuLine {
+    unsigned int scanline;
+    byte ppumask;
+    std::array<byte, 32> palette_table;
+    std::array<byte, NES_WIDTH> background; // Palette index of every pixel
+    std::array<SpritePixel, NES_WIDTH> sprites;
+};
+
+class PpuEventLog;
+enum class PpuEventType : uint8_t;
+class PpuOutputPool;
+
+// Draws a visible line: the colors of its pixels from their background palette indices, the
+// sprites on them and the palettes
+using PpuLineKernel = void (*)(
+    std::span<const byte, NES_WIDTH> background,
+    std::span<const SpritePixel, NES_WIDTH> sprites,
+    const std::array<byte, 32>& palette_table,
+    std::span<byte, NES_WIDTH> colors
+);
+
+// What the PPU does during a scanline, which decides the work done on each of its dots
+enum class ScanlineType : byte {
+    Visible,
+    PreRender,
+    PostRender,
+    VBlank,
+};
+
 class Ppu {
   private:
     struct ActiveSprite {
-        byte tile_lsb;
-        byte tile_msb;
+        std::array<byte, 8> pixels; // Left to right on screen
     };
 
-    std::array<byte, 2048> vram{};
+    // The console's 2KB of VRAM, plus the 2KB four-screen boards add for the other two nametables
+    std::vector<byte> vram = std::vector<byte>(0x800);
+    // 1KB page of `vram` each nametable at $2000-$2FFF maps to, redone when the mirroring changes
+    std::array<byte*, 4> nametable_pages{};
+    uint32_t mapped_nametable_generation{};
     std::array<Sprite, 64> oam{};
-    std::vector<std::pair<size_t, Sprite>> secondary_oam{};
-    std::vector<ActiveSprite> scanline_sprites_tile_data{};
+    // OAM indices of the sprites in range of each line, at most 8 and in OAM order. Rebuilt when
+    // OAM or the sprite height changed since it was last used
+    std::array<std::array<byte, 8>, NES_HEIGHT> line_sprites{};
+    std::array<byte, NES_HEIGHT> line_sprite_counts{};
+    std::bitset<NES_HEIGHT> line_sprite_overflows; // Lines whose evaluation sets sprite overflow
+    bool line_sprites_dirty{true};
+
+    std::array<std::pair<size_t, Sprite>, 8> secondary_oam{};
+    size_t secondary_oam_size{};
+    std::array<ActiveSprite, 8> scanline_sprites_tile_data{};
+    // Sprites of the line composed once their patterns are fetched
+    std::array<SpritePixel, NES_WIDTH> sprite_line{};
 
     // Due to mirroring of the palette indices we don't need exactly 32 bytes
     // Still keep it at 32 for easy indexing using the address
@@ -55,36 +158,31 @@ class Ppu {
     byte ppuctrl{};
     byte ppumask{};
     byte ppustatus{0x1F};
+    uint64_t status_changes{}; // Times the PPU has changed PPUSTATUS on its own
     byte oamaddr{};
     std::optional<byte> ppudata_buf = std::nullopt; // PPUDATA read buffer
 
-    // Rendering registers
-    union {
-        word value;
-
-        struct {
-            byte low;
-            byte high;
-        } as_bytes;
-
-        struct {
-            byte coarse_x_scroll : 5;
-            byte coarse_y_scroll_low : 3;
-            byte coarse_y_scroll_high : 2;
-            byte nametable_select : 2;
-            byte fine_y_scroll : 3;
-            byte : 1;
-
-            [[nodiscard]] byte coarse_y_scroll() const {
-                return (coarse_y_scroll_high << 3) | coarse_y_scroll_low;
-            }
-
-            void coarse_y_scroll(const byte data) {
-                coarse_y_scroll_low = data;
-                coarse_y_scroll_high = (data >> 3);
-            }
-        } as_scroll;
-    } v{.value = 0x0000}, t{.value = 0x0000}; // Current, Temporary VRAM address (15 bits)
+    // Rendering registers, laid out as yyy NN YYYYY XXXXX: fine Y, nametable, coarse Y, coarse X
+    static constexpr word COARSE_X_MASK = 0x001F;
+    static constexpr word COARSE_Y_MASK = 0x03E0;
+    static constexpr word NAMETABLE_MASK = 0x0C00;
+    static constexpr word FINE_Y_MASK = 0x7000;
+    static constexpr word HORIZONTAL_SCROLL_MASK = 0x041F; // Coarse X and the nametable X bit
+    static constexpr word VERTICAL_SCROLL_MASK = 0x7BE0; // Fine Y, coarse Y and nametable Y bit
+
+    word v{}, t{}; // Current, Temporary VRAM address (15 bits)
+
+    [[nodiscard]] static byte CoarseX(const word address) {
+        return address & COARSE_X_MASK;
+    }
+
+    [[nodiscard]] static byte CoarseY(const word address) {
+        return (address & COARSE_Y_MASK) >> 5;
+    }
+
+    [[nodiscard]] static byte FineY(const word address) {
+        return (address & FINE_Y_MASK) >> 12;
+    }
 
     byte fine_x{}; // (x) Fine X (3 bits)
     bool write_toggle{false}; // (w) 1 bit
@@ -94,32 +192,51 @@ class Ppu {
     // of the shift registers
     byte tile_id_latch{};
 
-    /* These contain the pattern table data for two tiles and their corresponding latches
-     * Every 8 cycles, the data for the next tile will be loaded into the upper 8 bits of these
-     *  The pixel to render will be fetched from the lower 8 bits
-     */
-    byte bg_pattern_msb_latch{}, bg_pattern_lsb_latch{};
-    word bg_pattern_msb_shift_reg{}, bg_pattern_lsb_shift_reg{};
-
-    // Latch for palette attribute for next tile. Updated every 8-cycles.
-    // Only 2 bits
-    byte bg_attrib_latch{};
+    // Decoded pattern of the next tile, fetched at once from the cartridge's tile cache
+    std::array<byte, 8> bg_tile_latch{};
     // Temp to hold palette attribute data until reloading
     byte bg_attrib_data{};
 
-    /* These contain the palette attributes for the lower 8 pixels of the 16-bit shift registers.
-     * These are fed from the latch which contains the palette attribute for the next tile
+    /* Background pixels of the current and next tile as palette indices (attribute << 2 | pixel),
+     * standing in for the pattern and attribute shift registers. Every 8 dots the next tile is
+     * loaded into the upper half. `bg_window_shift` counts the dots since then, so the pixel to
+     * render is `bg_window[bg_window_shift + fine_x]`
      */
-    byte bg_attrib_msb_shift_reg{}, bg_attrib_lsb_shift_reg{};
+    std::array<byte, 16> bg_window{};
+    unsigned int bg_window_shift{};
 
     // The first `Tick()` will put us at the start of pre-render line (261)
     unsigned int scanline{260};
     unsigned int line_cycles{340};
+    ScanlineType line_type{ScanlineType::VBlank}; // Of `scanline`
 
     std::shared_ptr<Cartridge> cartridge{};
-    std::shared_ptr<bool> nmi_requested{};
-
-    std::array<word, NES_WIDTH * NES_HEIGHT> framebuffer{};
+    InterruptLines* interrupts{};
+    uint64_t cpu_cycle{}; // CPU cycle the current dot belongs to
+
+    // With scanline rendering the background of a visible line is drawn in one go at dot 256
+    // instead of dot by dot. `line_deferred` is set while the current line has not been drawn yet
+    bool scanline_rendering{true};
+    bool line_deferred{false};
+    PpuLineKernel line_kernel{LineKernel(0x00)}; // For the current PPUMASK
+    PpuEventLog* event_log{};
+    // The cartridge counts rises of PPU A12, worked out from the fetch schedule rather than from
+    // the address of every pattern fetch. `a12_low_since` is the dot A12 last went low on,
+    // counted from power up
+    bool a12_watched{false};
+    uint64_t a12_low_since{};
+    // Dot of a deferred line after which sprite 0 hit is set, worked out when the line starts. 0
+    // if sprite 0 doesn't hit on it. Anything that could change it flushes the line first
+    unsigned int sprite_zero_hit_dot{};
+
+    // Without output the PPU still does everything the game can observe but leaves the
+    // framebuffer alone
+    bool output_enabled{true};
+    // Composes the lines drawn by the scanline renderer into the framebuffer when enabled
+    std::unique_ptr<PpuOutputPool> output_pool;
+    std::function<void(const PpuFramebuffer&)> frame_end_callback;
+
+    PpuFramebuffer framebuffer{};
 
     // Properties for the PPU
     [[nodiscard]] word BaseNametableAddress() const {
@@ -158,6 +275,10 @@ class Ppu {
         return (ppuctrl & 0x80) != 0x00;
     }
 
+    [[nodiscard]] byte Emphasis() const {
+        return ppumask >> 5;
+    }
+
     [[nodiscard]] bool Grayscale() const {
         return (ppumask & 0x01) != 0x00;
     }
@@ -178,22 +299,58 @@ class Ppu {
         return (ppumask & 0x10) != 0x00;
     }
 
+    // A sprite 0 hit could still happen on the current line
+    [[nodiscard]] bool SpriteZeroHitPending() const {
+        return (ppustatus & 0x40) == 0x00 && secondary_oam_size != 0
+            && secondary_oam.front().first == 0;
+    }
+
     [[nodiscard]] bool InVblank() const {
         // Bit 7 is set during VBlank
         return (ppustatus & 0x80) != 0x00;
     }
 
     void TickCounters();
-    void ShiftShifters();
-    void ReloadShiftersFromLatches();
+    void ShiftBgWindow() {
+        bg_window_shift++;
+    }
+
+    void ReloadBgWindow();
+    [[nodiscard]] std::array<byte, 8> LatchedTilePaletteIndices() const;
+    [[nodiscard]] byte TileAttribute(word address);
+    [[nodiscard]] word TileRowAddress(byte tile_id, word address) const;
+    [[nodiscard]] std::array<byte, 8> FetchTilePaletteIndices(word address);
+    [[nodiscard]] unsigned int PredictSpriteZeroHit();
     void ReadNextTileData(unsigned int cycle);
-    void RenderPixel();
+    void RenderDot(unsigned int dot);
+    void RenderPixel(byte screen_x);
+    void ComposePixel(byte screen_x, byte bg_palette_index);
+    void DetectSpriteZeroHit(byte screen_x, byte bg_palette_index);
+    void RenderDeferredLine();
     void FineYIncrement();
-    void CoarseXIncrement();
+    void CoarseXIncrement() {
+        v = CoarseXIncremented(v);
+    }
+    [[nodiscard]] static word CoarseXIncremented(word address);
     void SecondaryOamClear();
     void EvaluateNextLineSprites();
-
-    [[nodiscard]] size_t VramIndex(word address) const;
+    void FetchSpritePattern(size_t sprite_index);
+    [[nodiscard]] bool PatternFetchA12(unsigned int dot) const;
+    void WatchA12(unsigned int dot);
+    void IndexLineSprites();
+    [[nodiscard]] bool LineOverflows(unsigned int line) const;
+    void ComposeSpriteLine();
+
+    void MapNametables();
+
+    [[nodiscard]] byte& Nametable(const word address) {
+        if (mapped_nametable_generation != cartridge->nametable_generation()) {
+            MapNametables();
+        }
+        return nametable_pages[(address >> 10) & 0b11][address & 0x3FF];
+    }
+    [[nodiscard]] unsigned int
+    DotsUntil(unsigned int target_scanline, unsigned int target_cycle) const;
 
     friend class Debugger;
 
@@ -207,21 +364,124 @@ class Ppu {
 
     uint64_t frame_count{}; // Also used to determine if even or odd frame
 
-    Ppu() = default;
+    Ppu();
+    Ppu(std::shared_ptr<Cartridge> cartridge, InterruptLines* interrupts);
+    ~Ppu();
 
-    Ppu(std::shared_ptr<Cartridge> cartridge, std::shared_ptr<bool> nmi_requested) :
-        cartridge{std::move(cartridge)},
-        nmi_requested{std::move(nmi_requested)} {}
+    // The output thread draws into `framebuffer`
+    Ppu(const Ppu&) = delete;
+    Ppu& operator=(const Ppu&) = delete;
 
     [[nodiscard]] unsigned int Scanline() const {
         return scanline;
     }
 
-    void Tick();
+    [[nodiscard]] unsigned int LineCycles() const {
+        return line_cycles;
+    }
+
+    // Records register accesses and mapper writes into `log` from now on, or stops recording
+    void SetEventLog(PpuEventLog* log) {
+        event_log = log;
+    }
+
+    void RecordEvent(PpuEventType type, word address, byte value) const;
+
+    void Tick(uint64_t cpu_cycles);
+
+    // The scanline renderer falls back to dot by dot rendering for the rest of a line as soon as
+    // anything could observe or change the PPU mid-line: register accesses and mapper writes
+    // (through `FlushDeferredLine()`). Reads of PPUSTATUS are answered from the sprite 0 hit
+    // predicted when the line started instead
+    void SetScanlineRendering(bool enabled) {
+        FlushDeferredLine();
+        scanline_rendering = enabled;
+    }
+
+    [[nodiscard]] bool ScanlineRendering() const {
+        return scanline_rendering;
+    }
+
+    // Brings a line the scanline renderer has deferred up to the current dot
+    void FlushDeferredLine();
+
+    // For frames that will not be displayed: fetches, sprite 0 hits and scroll updates happen as
+    // usual but palette lookups, compositing and framebuffer writes are skipped
+    void SetOutputEnabled(const bool enabled) {
+        output_enabled = enabled;
+    }
+
+    [[nodiscard]] bool OutputEnabled() const {
+        return output_enabled;
+    }
+
+    // Hands the palette lookups and compositing of lines drawn by the scanline renderer to
+    // `threads` threads of their own, which draw them in parallel. Everything the game can
+    // observe stays on the calling thread, which waits for the output threads to catch up once
+    // the visible lines of a frame are done. 0 draws every line on the calling thread, which is
+    // the default: the background and sprites are still worked out here and every line is copied
+    // to hand it over, so this only pays off with cores to spare and is slower on a single one
+    void SetOutputThreads(size_t threads);
+
+    [[nodiscard]] size_t OutputThreads() const;
+
+    // Waits until the output threads have drawn every line handed to them so far
+    void FinishOutput() const;
+
+    // Host memory of the PPU, VRAM and the output pool included but not the cartridge
+    [[nodiscard]] size_t MemoryFootprint() const;
+
+    // Tile IDs of the nametable PPUCTRL selects, row by row
+    void CopyBaseNametable(std::span<byte, NAMETABLE_TILES> tiles) {
+        const byte* nametable = &Nametable(BaseNametableAddress());
+        std::copy_n(nametable, tiles.size(), tiles.begin());
+    }
+
+    // Called with the finished frame at the start of the post-render line, except for frames
+    // run without output
+    void SetFrameEndCallback(std::function<void(const PpuFramebuffer&)> callback) {
+        frame_end_callback = std::move(callback);
+    }
+
+    // With every line handed to the output threads drawn
+    [[nodiscard]] PpuFramebuffer& Framebuffer() {
+        FinishOutput();
+        return framebuffer;
+    }
+
+    // Palette address of a pixel after left column clipping and sprite priority
+    [[nodiscard]] static byte PixelPaletteAddress(
+        byte ppumask,
+        byte screen_x,
+        byte bg_palette_index,
+        const SpritePixel& sprite
+    );
+
+    // Line kernel for the left column clipping PPUMASK asks for, the only part of it that differs
+    // between pixels. Each one is compiled with the clipping fixed so its loop has no branches on
+    // PPUMASK
+    [[nodiscard]] static PpuLineKernel LineKernel(byte ppumask);
+
+    // Number of PPU dots until the PPU next changes PPUSTATUS or the NMI line on its own. When
+    // `status_polled` is false only the start of VBlank is considered
+    [[nodiscard]] unsigned int DotsUntilNextStatusEvent(bool status_polled) const;
+
+    // Number of PPU dots until the cartridge asserts IRQ after counting PPU A12 rises, if it is
+    // going to. 0 if that can't be worked out ahead
+    [[nodiscard]] std::optional<unsigned int> DotsUntilMapperIrq() const;
+
+    // Number of PPU dots until `target_scanline` next starts
+    [[nodiscard]] unsigned int DotsUntilScanline(const unsigned int target_scanline) const {
+        return DotsUntil(target_scanline, 0);
+    }
+
+    [[nodiscard]] uint64_t StatusChanges() const {
+        return status_changes;
+    }
 
     byte CpuRead(word address);
     void CpuWrite(word address, byte data);
 
-    byte PpuRead(word address) const;
+    byte PpuRead(word address);
     void PpuWrite(word address, byte data);
 };
\ No newline at end of file
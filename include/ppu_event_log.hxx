@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "constants.hxx"
+
+class Ppu;
+
+enum class PpuEventType : uint8_t {
+    RegisterRead,
+    RegisterWrite,
+    MapperWrite,
+    Nmi,
+    Irq,
+};
+
+// Something the PPU or the game did during a frame, and where the PPU was when it happened
+struct PpuEvent {
+    PpuEventType type;
+    byte value; // Read or written, the `IrqSource` for IRQs
+    word address; // PPU register or mapper address, 0 for interrupts
+    word pc; // Of the instruction that was executing
+    uint16_t scanline;
+    uint16_t dot;
+    uint64_t frame;
+};
+
+// PPU register accesses, mapper writes and interrupts of the frame in progress and of the one
+// before it, for the event viewer. Both buffers are allocated up front so recording never
+// allocates. Events past `CAPACITY` in a frame are counted but not kept
+class PpuEventLog {
+  private:
+    const Ppu& ppu;
+    std::function<word()> program_counter;
+
+    std::vector<PpuEvent> current, last;
+    size_t current_dropped{}, last_dropped{};
+    bool paused{false};
+
+  public:
+    static constexpr size_t CAPACITY = 0x8000;
+
+    // `program_counter` gives the address of the instruction the CPU is executing
+    PpuEventLog(const Ppu& ppu, std::function<word()> program_counter) :
+        ppu{ppu},
+        program_counter{std::move(program_counter)} {
+        current.reserve(CAPACITY);
+        last.reserve(CAPACITY);
+    }
+
+    void Record(PpuEventType type, word address, byte value);
+
+    // While paused nothing is recorded and the last complete frame stays as it was. The buffers
+    // are kept for when recording resumes
+    void SetPaused(const bool paused) {
+        this->paused = paused;
+    }
+
+    [[nodiscard]] bool Paused() const {
+        return paused;
+    }
+
+    // Called by the PPU when the next frame starts on scanline 0
+    void StartFrame() {
+        if (!paused) {
+            std::swap(current, last);
+            last_dropped = current_dropped;
+        }
+        // A frame paused part way through is dropped
+        current.clear();
+        current_dropped = 0;
+    }
+
+    // Events of the last complete frame, in the order they happened
+    [[nodiscard]] std::span<const PpuEvent> LastFrame() const {
+        return last;
+    }
+
+    [[nodiscard]] size_t LastFrameDropped() const {
+        return last_dropped;
+    }
+
+    // Host memory of the log and both of its buffers
+    [[nodiscard]] size_t MemoryFootprint() const {
+        return sizeof(PpuEventLog) + (current.capacity() + last.capacity()) * sizeof(PpuEvent);
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "constants.hxx"
+#include "ppu.hxx"
+
+// Draws lines handed over by the PPU into its framebuffer on threads of their own. The PPU fills
+// the slots of a ring in place and publishes them one by one. With N threads, thread k draws
+// every line whose sequence number is k modulo N, so lines are composed in parallel without the
+// threads ever touching the same slot or framebuffer row, and each only sleeps while it has
+// nothing left to draw
+class PpuOutputPool {
+  private:
+    static constexpr size_t RING_SIZE = 64;
+
+    struct alignas(64) Worker {
+        // Sequence number of the next line this worker draws. Everything before it that is
+        // assigned to this worker is drawn
+        std::atomic<uint64_t> next{};
+        std::thread thread;
+    };
+
+    std::array<PpuLine, RING_SIZE> lines{};
+    alignas(64) std::atomic<uint64_t> submitted{}; // Lines published by the PPU since startup
+    std::atomic<bool> stopping{false};
+
+    PpuFramebuffer& framebuffer;
+    size_t worker_count;
+    std::unique_ptr<Worker[]> workers;
+
+    void Run(size_t worker_index);
+
+  public:
+    PpuOutputPool(PpuFramebuffer& framebuffer, size_t threads);
+    ~PpuOutputPool();
+
+    PpuOutputPool(const PpuOutputPool&) = delete;
+    PpuOutputPool& operator=(const PpuOutputPool&) = delete;
+
+    [[nodiscard]] size_t threads() const {
+        return worker_count;
+    }
+
+    // Slot for the next line, waiting for its previous line to be drawn if the ring is full.
+    // Only touched by the workers once it is published with `Submit()`
+    PpuLine& NextLine();
+    void Submit();
+
+    // Waits until every published line has been drawn
+    void Finish() const;
+};
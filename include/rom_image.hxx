@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "chr_tile_cache.hxx"
+#include "constants.hxx"
+
+enum Mirroring {
+    Horizontal,
+    Vertical,
+    FourScreenVram,
+    SingleScreenLower, // Every nametable is the first 1KB of VRAM
+    SingleScreenUpper, // Or the second
+};
+
+struct RomHeader {
+    size_t prg_rom_size;
+    size_t prg_rom_banks;
+
+    size_t chr_rom_size;
+    size_t chr_rom_banks;
+
+    size_t prg_ram_size;
+
+    Mirroring hardware_mirroring;
+    word mapper_number;
+    byte submapper = 0; // Only NES 2.0 headers have one
+    bool battery_backed_ram = false;
+
+    bool operator==(const RomHeader&) const = default;
+};
+
+// The read-only parts of a ROM file. Nothing writes to it once it is loaded, so every instance
+// running the same ROM maps its banks out of one image instead of a copy of its own. CHR-ROM is
+// decoded into tile rows up front for the same reason, instead of lazily by each instance
+struct RomImage {
+    RomHeader header;
+    std::vector<byte> prg_rom;
+    std::vector<byte> chr_rom; // Empty for cartridges with CHR-RAM
+    ChrTileCache chr_tiles;
+
+    RomImage(const RomHeader& header, std::vector<byte>&& prg_rom, std::vector<byte>&& chr_rom);
+
+    // Host memory held by the image, shared between everyone using it
+    [[nodiscard]] size_t footprint() const {
+        return sizeof(RomImage) + prg_rom.size() + chr_rom.size() + chr_tiles.footprint();
+    }
+};
+
+// Images loaded so far, by content. The cache only holds weak references, an image goes away
+// with the last cartridge using it
+class RomImageCache {
+  public:
+    // The one the ROM loader goes through
+    static RomImageCache& global();
+
+    // The image with `header` and these contents, loaded now if no one has it loaded already
+    std::shared_ptr<const RomImage>
+    get(const RomHeader& header, std::span<const byte> prg_rom, std::span<const byte> chr_rom);
+
+    // Images currently alive
+    [[nodiscard]] size_t size();
+
+  private:
+    std::mutex mutex; // Instances are created from several threads
+    std::vector<std::weak_ptr<const RomImage>> images;
+
+    void drop_expired();
+};
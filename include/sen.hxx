@@ -1,8 +1,11 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <span>
+#include <utility>
 #include <vector>
 
 #include "apu.hxx"
@@ -10,7 +13,10 @@
 #include "cartridge.hxx"
 #include "constants.hxx"
 #include "controller.hxx"
+#include "interrupts.hxx"
 #include "ppu.hxx"
+#include "ppu_event_log.hxx"
+#include "rom_image.hxx"
 // Stay down!
 #include "cpu.hxx"
 
@@ -19,11 +25,40 @@ struct RomArgs {
     std::optional<std::vector<byte>> ram = std::nullopt;
 };
 
+// The image of the ROM file in `rom_args`, shared with everyone else who loaded the same file
+std::shared_ptr<const RomImage> LoadRomImage(const RomArgs& rom_args);
 std::shared_ptr<Cartridge> ParseRomFile(const RomArgs& rom_args);
 
+// Host memory an instance takes up, in bytes
+struct MemoryFootprint {
+    size_t shared; // The ROM image, shared with every other instance running the same ROM
+    size_t instance; // Only used by this one, CHR-RAM and PRG-RAM included
+};
+
+// When `Sen::RunUntil()` should return. Conditions are checked after every instruction, so at
+// least one instruction always runs
+struct StopConditions {
+    std::optional<uint64_t> cycles{}; // CPU cycles to run for at most
+    bool frame_end{false}; // Once the visible lines of a frame are done
+    std::optional<unsigned int> scanline{}; // Once the PPU gets to this scanline, or past it
+    std::optional<word> breakpoint{}; // Before executing the instruction at this address
+    std::optional<word> ram_write{}; // After an instruction writes to this RAM address
+    bool jam{true}; // Once the CPU locks up on a JAM opcode
+};
+
+enum class StopReason : uint8_t {
+    Cycles,
+    FrameEnd,
+    Scanline,
+    Breakpoint,
+    RamWrite,
+    Jam,
+};
+
 class Sen {
   private:
     Cpu<Bus> cpu;
+    std::shared_ptr<Cartridge> cartridge;
     std::shared_ptr<Bus> bus;
     std::shared_ptr<Ppu> ppu;
     std::shared_ptr<Controller> controller;
@@ -31,22 +66,108 @@ class Sen {
 
     uint64_t carry_over_cycles{};
 
-    InterruptRequestFlag nmi_requested, irq_requested;
+    InterruptLines interrupts{};
     bool running{false};
 
+    bool idle_loop_skipping{false};
+    uint64_t idle_status_changes{};
+    uint64_t idle_stats_frame{};
+    uint64_t idle_cycles_this_frame{}, idle_cycles_last_frame{};
+
+    std::unique_ptr<PpuEventLog> event_log{};
+
+    void SkipIdleLoop(uint64_t target_cycles);
+
   public:
     explicit Sen(const RomArgs& rom_args, const std::shared_ptr<AudioQueue>& sink);
 
+    // The CPU, PPU and APU point into `interrupts`
+    Sen(const Sen&) = delete;
+    Sen& operator=(const Sen&) = delete;
+
     [[nodiscard]] uint64_t FrameCount() const {
         return ppu->frame_count;
     }
 
     void RunForCycles(uint64_t cycles);
+    // Runs until any of `conditions` is met and returns the first one found
+    StopReason RunUntil(const StopConditions& conditions);
     void StepOpcode();
     void RunForOneScanline();
-    void RunForOneFrame();
+    // With `render` false the frame runs as usual but nothing is drawn into the framebuffer, for
+    // frames that are never displayed
+    void RunForOneFrame(bool render = true);
 
     void set_pressed_keys(ControllerPort port, byte key) const;
 
+    // Called with the finished frame once its visible lines are done, see
+    // `Ppu::SetFrameEndCallback()`
+    void SetFrameEndCallback(std::function<void(const PpuFramebuffer&)> callback) const {
+        ppu->SetFrameEndCallback(std::move(callback));
+    }
+
+    // Observations of the current frame for agents, written into buffers the caller provides.
+    // See `DownsampleLuma()`
+    void ObserveLuma(std::span<byte> luma, size_t width, size_t height) const;
+    void ObserveRam(std::span<byte, IWRAM_SIZE> ram) const;
+    void ObserveNametable(std::span<byte, NAMETABLE_TILES> tiles) const;
+
+    // Detect loops that spin waiting on the PPU or an interrupt and run the rest of the system
+    // forward without decoding them again
+    void SetIdleLoopSkipping(bool enabled);
+
+    [[nodiscard]] bool IdleLoopSkipping() const {
+        return idle_loop_skipping;
+    }
+
+    // CPU cycles of the last frame spent in idle loops without decoding them. The PPU and APU
+    // still ran through every one of them, a cycle at a time
+    [[nodiscard]] uint64_t IdleCyclesFastForwardedLastFrame() const {
+        return idle_cycles_last_frame;
+    }
+
+    // Draw the background a whole scanline at a time where no one can tell the difference
+    void SetScanlineRendering(const bool enabled) const {
+        ppu->SetScanlineRendering(enabled);
+    }
+
+    [[nodiscard]] bool ScanlineRendering() const {
+        return ppu->ScanlineRendering();
+    }
+
+    // Compose the lines the scanline renderer draws on `threads` other threads, 0 for none
+    void SetOutputThreads(const size_t threads) const {
+        ppu->SetOutputThreads(threads);
+    }
+
+    [[nodiscard]] size_t OutputThreads() const {
+        return ppu->OutputThreads();
+    }
+
+    // Record every PPU register access, mapper write and interrupt with the scanline and dot it
+    // happened on, for the event viewer. While disabled each of them only checks a null pointer
+    void SetEventLogging(bool enabled);
+
+    [[nodiscard]] bool EventLogging() const {
+        return event_log != nullptr;
+    }
+
+    // Stops appending to the event log without freeing it, or resumes. Does nothing while event
+    // logging is disabled
+    void SetEventLogPaused(const bool paused) const {
+        if (event_log != nullptr) {
+            event_log->SetPaused(paused);
+        }
+    }
+
+    // Null while event logging is disabled
+    [[nodiscard]] const PpuEventLog* EventLog() const {
+        return event_log.get();
+    }
+
+    // What the ROM image shared with other instances takes up, and what this instance adds on
+    // top
+    [[nodiscard]] MemoryFootprint Footprint() const;
+
     friend class Debugger;
 };
@@ -47,7 +47,7 @@ std::optional<word> Apu::Tick(const uint64_t cpu_cycles) {
 
     if (step_mode == FrameCounterStepMode::FourStep && cpu_cycles_into_frame == 29828
         && raise_irq) {
-        *irq_requested = true;
+        interrupts->AssertIrq(IrqSource::FrameCounter, cpu_cycles);
     }
 
     if (cpu_cycles_into_frame == 29829) {
@@ -65,13 +65,17 @@ std::optional<word> Apu::Tick(const uint64_t cpu_cycles) {
         noise.ClockEnvelope();
         noise.ClockLengthCounter();
 
-        *irq_requested = raise_irq;
+        if (raise_irq) {
+            interrupts->AssertIrq(IrqSource::FrameCounter, cpu_cycles);
+        }
     }
 
     if (step_mode == FrameCounterStepMode::FourStep && cpu_cycles_into_frame == 29830) {
         // TODO: 4 step frame end
         frame_begin_cpu_cycle = cpu_cycles;
-        *irq_requested = raise_irq;
+        if (raise_irq) {
+            interrupts->AssertIrq(IrqSource::FrameCounter, cpu_cycles);
+        }
     }
 
     if (step_mode == FrameCounterStepMode::FiveStep && cpu_cycles_into_frame == 37281) {
@@ -117,6 +121,15 @@ std::optional<word> Apu::Tick(const uint64_t cpu_cycles) {
     return dmc_sample_read_addr;
 }
 
+std::optional<uint64_t> Apu::CyclesUntilFrameIrq(const uint64_t cpu_cycles) const {
+    if (step_mode != FrameCounterStepMode::FourStep || !raise_irq) {
+        return std::nullopt;
+    }
+
+    const uint64_t cpu_cycles_into_frame = cpu_cycles - frame_begin_cpu_cycle;
+    return cpu_cycles_into_frame < 29828 ? 29828 - cpu_cycles_into_frame : 0;
+}
+
 byte Apu::CpuRead(const word address) {
     if (address == 0x4015U) {
         byte res = 0x00;
@@ -138,6 +151,7 @@ byte Apu::CpuRead(const word address) {
         }
 
         raise_irq = false;
+        interrupts->ReleaseIrq(IrqSource::FrameCounter);
 
         return res;
     }
@@ -156,6 +170,8 @@ void Apu::CpuWrite(const word address, const byte data) {
     } else if (InRange<word>(0x4010, address, 0x4013)) {
         dmc.WriteRegister(address - 0x4010, data);
     } else if (address == 0x4015) {
+        // Writing to the status register acknowledges the DMC IRQ
+        interrupts->ReleaseIrq(IrqSource::Dmc);
         update_enabled_channels(data);
     } else if (address == 0x4017U) {
         // TODO: If the write occurs during an APU cycle, the effects occur 3 CPU cycles after
@@ -229,6 +245,9 @@ void Apu::UpdateFrameCounter(const byte data) {
     step_mode =
         (data & 0x80U) != 0x00 ? FrameCounterStepMode::FiveStep : FrameCounterStepMode::FourStep;
     raise_irq = (data & 0x40U) == 0x00;
+    if (!raise_irq) {
+        interrupts->ReleaseIrq(IrqSource::FrameCounter);
+    }
 }
 
 float Apu::Mix(
@@ -0,0 +1,740 @@
+#include "batch_cpu.hxx"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <vector>
+
+#include "apu.hxx"
+#include "constants.hxx"
+#include "controller.hxx"
+#include "cpu.hxx"
+#include "mapper.hxx"
+#include "observations.hxx"
+#include "ppu.hxx"
+#include "sen.hxx"
+#include "util.hxx"
+
+namespace {
+
+class DiscardingAudioQueue final : public AudioQueue {
+  public:
+    void push(float) override {}
+};
+
+bool flag_set(const byte p, const StatusFlag flag) {
+    return (p & static_cast<byte>(flag)) != 0;
+}
+
+void update_flag(byte& p, const StatusFlag flag, const bool value) {
+    if (value) {
+        p |= static_cast<byte>(flag);
+    } else {
+        p &= ~static_cast<byte>(flag);
+    }
+}
+
+// Written without branches so the loops over lanes using it can be vectorized
+void update_zero_negative(byte& p, const byte value) {
+    constexpr auto zero = static_cast<byte>(StatusFlag::Zero);
+    constexpr auto negative = static_cast<byte>(StatusFlag::Negative);
+    p = (p & ~(zero | negative)) | (value == 0x00 ? zero : 0x00) | (value & negative);
+}
+
+void add_with_carry(byte& a, byte& p, const word operand) {
+    const auto temp_a = static_cast<word>(a);
+    const word result =
+        temp_a + operand + static_cast<word>(p & static_cast<byte>(StatusFlag::Carry));
+
+    update_flag(p, StatusFlag::Zero, (result & 0xFF) == 0x00);
+    update_flag(p, StatusFlag::Negative, (result & 0x80) != 0x00);
+    update_flag(p, StatusFlag::Carry, result > 0xFF);
+    update_flag(
+        p, StatusFlag::Overflow, ((~(temp_a ^ operand) & (temp_a ^ result)) & 0x80) != 0x00
+    );
+
+    a = static_cast<byte>(result);
+}
+
+void compare(byte& p, const byte reg, const byte operand) {
+    update_zero_negative(p, reg - operand);
+    // The carry flag is set if no borrow or greater than or equal for A - M
+    update_flag(p, StatusFlag::Carry, reg >= operand);
+}
+
+bool branch_taken(const OpcodeClass opcode_class, const byte p) {
+    switch (opcode_class) {
+        case OpcodeClass::BCC:
+            return !flag_set(p, StatusFlag::Carry);
+        case OpcodeClass::BCS:
+            return flag_set(p, StatusFlag::Carry);
+        case OpcodeClass::BEQ:
+            return flag_set(p, StatusFlag::Zero);
+        case OpcodeClass::BMI:
+            return flag_set(p, StatusFlag::Negative);
+        case OpcodeClass::BNE:
+            return !flag_set(p, StatusFlag::Zero);
+        case OpcodeClass::BPL:
+            return !flag_set(p, StatusFlag::Negative);
+        case OpcodeClass::BVC:
+            return !flag_set(p, StatusFlag::Overflow);
+        default:
+            return flag_set(p, StatusFlag::Overflow);
+    }
+}
+
+word stack(const byte pointer) {
+    return 0x100 + static_cast<word>(pointer);
+}
+
+} // namespace
+
+LaneBus::LaneBus(BatchCpu& batch, const size_t lane) :
+    batch{&batch},
+    lane{lane},
+    cycles{batch.cycles[lane]} {}
+
+void LaneBus::tick() {
+    batch->idle(lane);
+}
+
+byte LaneBus::cpu_read(const word address) {
+    return batch->cpu_read(lane, address);
+}
+
+void LaneBus::cpu_write(const word address, const byte data) {
+    batch->cpu_write(lane, address, data);
+}
+
+byte LaneBus::ticked_cpu_read(const word address) {
+    return batch->read(lane, address);
+}
+
+void LaneBus::ticked_cpu_write(const word address, const byte data) {
+    batch->write(lane, address, data);
+}
+
+std::span<const byte* const, 8> LaneBus::prg_windows() const {
+    return batch->cartridges[lane]->mapped_prg_windows();
+}
+
+BatchCpu::BatchCpu(const RomArgs& rom_args, const size_t lanes) :
+    lane_count{lanes},
+    a(lanes, 0x00),
+    x(lanes, 0x00),
+    y(lanes, 0x00),
+    s(lanes, 0xFD),
+    p(lanes, 0x34),
+    pc(lanes, 0x0000),
+    cycles(lanes, 0),
+    system_cycles(lanes, 0),
+    carry_over_cycles(lanes, 0),
+    interrupt_deadlines(lanes, 0),
+    ram(lanes * IWRAM_SIZE, 0xFF),
+    interrupts(lanes),
+    target_cycles(lanes, 0) {
+    const auto image = LoadRomImage(rom_args);
+    auto cartridge = init_mapper(image);
+    shared_cartridge = cartridge->header.mapper_number == 0x00 && !cartridge->has_chr_ram();
+
+    const auto audio_sink = std::make_shared<DiscardingAudioQueue>();
+    cartridges.reserve(lanes);
+    ppus.reserve(lanes);
+    apus.reserve(lanes);
+    controllers.reserve(lanes);
+    for (size_t lane = 0; lane < lanes; lane++) {
+        if (lane > 0 && !shared_cartridge) {
+            cartridge = init_mapper(image);
+        }
+        cartridges.push_back(cartridge);
+        ppus.push_back(std::make_shared<Ppu>(cartridge, &interrupts[lane]));
+        apus.push_back(std::make_shared<Apu>(audio_sink, &interrupts[lane]));
+        controllers.push_back(std::make_shared<Controller>());
+    }
+
+    group.reserve(lanes);
+    cpus.reserve(lanes);
+    for (size_t lane = 0; lane < lanes; lane++) {
+        cpus.emplace_back(std::make_shared<LaneBus>(*this, lane), &interrupts[lane]);
+    }
+}
+
+void BatchCpu::catch_up(const size_t lane) {
+    auto& ppu = *ppus[lane];
+    auto& apu = *apus[lane];
+    while (system_cycles[lane] < cycles[lane]) {
+        const auto cycle = ++system_cycles[lane];
+        // Each CPU cycle is 3 PPU cycles
+        ppu.Tick(cycle);
+        ppu.Tick(cycle);
+        ppu.Tick(cycle);
+
+        apu.Tick(cycle);
+    }
+}
+
+void BatchCpu::catch_up_for_interrupts(const size_t lane) {
+    // The lines are polled for anything asserted before the current cycle
+    if (cycles[lane] <= interrupt_deadlines[lane]) {
+        return;
+    }
+    catch_up(lane);
+
+    // VBlank raises NMI, the APU frame counter and the cartridge raise IRQ. Anything else that
+    // changes the lines is the CPU writing to them, which makes the deadline stale
+    const auto& ppu = *ppus[lane];
+    const auto now = cycles[lane];
+    auto deadline = now + ppu.DotsUntilNextStatusEvent(false) / 3;
+    if (const auto frame_irq = apus[lane]->CyclesUntilFrameIrq(now); frame_irq) {
+        deadline = std::min(deadline, now + *frame_irq);
+    }
+    if (const auto mapper_irq = ppu.DotsUntilMapperIrq(); mapper_irq) {
+        deadline = std::min(deadline, now + *mapper_irq / 3);
+    }
+    interrupt_deadlines[lane] = deadline;
+}
+
+byte BatchCpu::cpu_read(const size_t lane, const word address) {
+    if (InRange<word>(0x0000, address, 0x1FFF)) {
+        return lane_ram(lane)[address % IWRAM_SIZE];
+    } else if (InRange<word>(0x2000, address, 0x3FFF)) {
+        return ppus[lane]->CpuRead(address);
+    } else if (address == 0x4014) {
+        // TODO: CPU Open Bus
+        return 0xFF;
+    } else if (InRange<word>(0x4000, address, 0x4015)) {
+        return apus[lane]->CpuRead(address);
+    } else if (InRange<word>(0x4016, address, 0x4017)) {
+        return controllers[lane]->CpuRead(address);
+    } else if (InRange<word>(0x4018, address, 0x401F)) {
+        return 0xFF;
+    }
+
+    return cartridges[lane]->cpu_read(cycles[lane], address);
+}
+
+void BatchCpu::cpu_write(const size_t lane, const word address, const byte data) {
+    if (InRange<word>(0x0000, address, 0x1FFF)) {
+        lane_ram(lane)[address % IWRAM_SIZE] = data;
+    } else if (InRange<word>(0x2000, address, 0x3FFF)) {
+        ppus[lane]->CpuWrite(address, data);
+    } else if (address == 0x4014) {
+        perform_oam_dma(lane, data);
+    } else if (InRange<word>(0x4000, address, 0x4015) || address == 0x4017) {
+        apus[lane]->CpuWrite(address, data);
+    } else if (address == 0x4016) {
+        controllers[lane]->CpuWrite(address, data);
+    } else if (InRange<word>(0x4018, address, 0x401F)) {
+    } else {
+        if (address >= 0x8000) {
+            // Mapper registers can switch CHR banks and mirroring
+            ppus[lane]->FlushDeferredLine();
+        }
+        cartridges[lane]->cpu_write(cycles[lane], address, data);
+    }
+}
+
+byte BatchCpu::read(const size_t lane, const word address) {
+    cycles[lane]++;
+    if (address < 0x2000) {
+        return lane_ram(lane)[address % IWRAM_SIZE];
+    }
+    if (shared_cartridge && address >= PRG_ROM_START) {
+        // Nothing else can see reads from a cartridge without state of its own
+        return cartridges[lane]->cpu_read(cycles[lane], address);
+    }
+
+    catch_up(lane);
+    interrupt_deadlines[lane] = 0;
+    return cpu_read(lane, address);
+}
+
+void BatchCpu::write(const size_t lane, const word address, const byte data) {
+    cycles[lane]++;
+    if (address < 0x2000) {
+        lane_ram(lane)[address % IWRAM_SIZE] = data;
+        return;
+    }
+
+    catch_up(lane);
+    interrupt_deadlines[lane] = 0;
+    cpu_write(lane, address, data);
+}
+
+void BatchCpu::idle(const size_t lane) {
+    cycles[lane]++;
+}
+
+void BatchCpu::perform_oam_dma(const size_t lane, const byte high) {
+    word address = static_cast<word>(high) << 8;
+    const word end = address + 0x100;
+
+    // Wait cycle - 1
+    idle(lane);
+    for (; address < end; address++) {
+        write(lane, 0x2004, read(lane, address)); // 2 ticks - total 256
+    }
+}
+
+void BatchCpu::start() {
+    for (size_t lane = 0; lane < lane_count; lane++) {
+        start_lane(lane);
+    }
+    spdlog::info("Starting execution of {} lanes at {:#06X}", lane_count, pc.front());
+}
+
+void BatchCpu::start_lane(const size_t lane) {
+    // The CPU start procedure takes 7 NES cycles
+    read(lane, 0x0000); // Address does not matter
+    read(lane, 0x0001); // First start state
+    read(lane, stack(s[lane])); // Second start state
+    read(lane, stack(s[lane] - 1)); // Third start state
+    read(lane, stack(s[lane] - 2)); // Fourth start state
+    const auto pcl = static_cast<word>(read(lane, Cpu<Bus>::RESET_VECTOR));
+    const auto pch = static_cast<word>(read(lane, Cpu<Bus>::RESET_VECTOR + 1));
+    pc[lane] = (pch << 8) | pcl;
+}
+
+void BatchCpu::run_for_one_frame(const bool render) {
+    if (!running) {
+        running = true;
+        start();
+    }
+    for (const auto& ppu : ppus) {
+        ppu->SetOutputEnabled(render);
+    }
+
+    for (size_t lane = 0; lane < lane_count; lane++) {
+        target_cycles[lane] = cycles[lane] + CYCLES_PER_FRAME - carry_over_cycles[lane];
+    }
+
+    // Every lane starts out in the group, the ones not at the PC most of them are at leave it
+    group.clear();
+    for (size_t lane = 0; lockstep && lane < lane_count; lane++) {
+        group.push_back(lane);
+    }
+    regroup();
+
+    while (group.size() > 1) {
+        const auto first_lane = group.front();
+        const auto start_cycles = cycles[first_lane];
+        const word group_pc = pc[first_lane];
+
+        bool diverged = false;
+        const bool stepped = group.size() == lane_count
+            ? step_together(std::views::iota(size_t{0}, lane_count), group_pc, diverged)
+            : step_together(group, group_pc, diverged);
+        if (stepped) {
+            lockstep_instructions += group.size();
+            // Every lane took as many cycles as the first one unless they diverged
+            const auto elapsed = cycles[first_lane] - start_cycles;
+            group_cycles_left -= std::min(elapsed, group_cycles_left);
+        } else {
+            group_cycles_left = std::numeric_limits<uint64_t>::max();
+            for (const auto lane : group) {
+                step_lane(lane);
+                diverged = diverged || pc[lane] != pc[first_lane];
+                group_cycles_left = std::min(
+                    group_cycles_left,
+                    target_cycles[lane] - std::min(cycles[lane], target_cycles[lane])
+                );
+            }
+        }
+
+        if (diverged || group_cycles_left == 0) {
+            regroup();
+        }
+    }
+
+    for (const auto lane : group) {
+        run_lane_to_frame_end(lane);
+    }
+    for (size_t lane = 0; lane < lane_count; lane++) {
+        if (!lockstep) {
+            run_lane_to_frame_end(lane);
+        }
+        catch_up(lane);
+        carry_over_cycles[lane] = cycles[lane] - target_cycles[lane];
+        ppus[lane]->SetOutputEnabled(true);
+    }
+}
+
+void BatchCpu::run_lane_to_frame_end(const size_t lane) {
+    while (cycles[lane] < target_cycles[lane]) {
+        step_lane(lane);
+    }
+}
+
+void BatchCpu::regroup() {
+    // Majority vote, finds the PC more than half of the running lanes are at if there is one
+    word majority_pc = 0x0000;
+    size_t votes = 0;
+    for (const auto lane : group) {
+        if (cycles[lane] >= target_cycles[lane]) {
+            continue;
+        }
+        if (votes == 0) {
+            majority_pc = pc[lane];
+        }
+        votes = pc[lane] == majority_pc ? votes + 1 : votes - 1;
+    }
+
+    for (const auto lane : group) {
+        if (pc[lane] != majority_pc) {
+            run_lane_to_frame_end(lane);
+        }
+    }
+    std::erase_if(group, [this](const size_t lane) { return cycles[lane] >= target_cycles[lane]; });
+
+    group_cycles_left = std::numeric_limits<uint64_t>::max();
+    for (const auto lane : group) {
+        group_cycles_left = std::min(group_cycles_left, target_cycles[lane] - cycles[lane]);
+    }
+}
+
+void BatchCpu::set_pressed_keys(const size_t lane, const ControllerPort port, const byte keys)
+    const {
+    controllers[lane]->set_pressed_keys(port, keys);
+}
+
+void BatchCpu::observe_luma(
+    const size_t lane,
+    const std::span<byte> luma,
+    const size_t width,
+    const size_t height
+) const {
+    DownsampleLuma(ppus[lane]->Framebuffer(), luma, width, height);
+}
+
+void BatchCpu::observe_ram(const size_t lane, const std::span<byte, IWRAM_SIZE> ram) const {
+    std::copy_n(this->ram.begin() + lane * IWRAM_SIZE, IWRAM_SIZE, ram.begin());
+}
+
+void BatchCpu::observe_nametable(const size_t lane, const std::span<byte, NAMETABLE_TILES> tiles)
+    const {
+    ppus[lane]->CopyBaseNametable(tiles);
+}
+
+template<typename LaneRange>
+bool BatchCpu::step_together(const LaneRange& lanes, const word pc_value, bool& diverged) {
+    using Mode = AddressingMode;
+
+    // Only code from a cartridge shared by all lanes is guaranteed to be the same for every lane
+    if (!shared_cartridge || pc_value < PRG_ROM_START || pc_value == 0xFFFF) {
+        return false;
+    }
+
+    auto& cartridge = *cartridges.front();
+    const auto first_lane = *std::ranges::begin(lanes);
+    const Opcode& opcode = OPCODES[cartridge.cpu_read(cycles[first_lane], pc_value)];
+    const auto opcode_class = opcode.opcode_class;
+    const auto mode = opcode.addressing_mode;
+
+    bool batched = false;
+    switch (mode) {
+        case Mode::Implied:
+            switch (opcode_class) {
+                case OpcodeClass::CLC:
+                case OpcodeClass::SEC:
+                case OpcodeClass::CLD:
+                case OpcodeClass::SED:
+                case OpcodeClass::CLI:
+                case OpcodeClass::SEI:
+                case OpcodeClass::CLV:
+                case OpcodeClass::INX:
+                case OpcodeClass::INY:
+                case OpcodeClass::DEX:
+                case OpcodeClass::DEY:
+                case OpcodeClass::TAX:
+                case OpcodeClass::TAY:
+                case OpcodeClass::TSX:
+                case OpcodeClass::TXA:
+                case OpcodeClass::TXS:
+                case OpcodeClass::TYA:
+                case OpcodeClass::NOP:
+                    batched = true;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case Mode::Immediate:
+        case Mode::ZeroPage:
+            switch (opcode_class) {
+                case OpcodeClass::LDA:
+                case OpcodeClass::LDX:
+                case OpcodeClass::LDY:
+                case OpcodeClass::AND:
+                case OpcodeClass::ORA:
+                case OpcodeClass::EOR:
+                case OpcodeClass::ADC:
+                case OpcodeClass::SBC:
+                case OpcodeClass::CMP:
+                case OpcodeClass::CPX:
+                case OpcodeClass::CPY:
+                    batched = true;
+                    break;
+                case OpcodeClass::BIT:
+                case OpcodeClass::STA:
+                case OpcodeClass::STX:
+                case OpcodeClass::STY:
+                    batched = mode == Mode::ZeroPage;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case Mode::Relative:
+            batched = true;
+            break;
+        default:
+            break;
+    }
+    if (!batched) {
+        return false;
+    }
+
+    // Interrupts are polled before the opcode fetch
+    for (const auto lane : lanes) {
+        catch_up_for_interrupts(lane);
+        const auto& lines = interrupts[lane];
+        if (lines.NmiPolled(cycles[lane])
+            || (!flag_set(p[lane], StatusFlag::InterruptDisable)
+                && lines.IrqPolled(cycles[lane]))) {
+            return false;
+        }
+    }
+
+    const byte argument = cartridge.cpu_read(cycles[first_lane], pc_value + 1);
+    const auto next_pc = static_cast<word>(pc_value + opcode.length);
+
+    if (mode == Mode::Relative) {
+        const auto offset = static_cast<word>(static_cast<int16_t>(static_cast<int8_t>(argument)));
+        const word target = next_pc + offset;
+        const unsigned int taken_cycles =
+            target != non_page_crossing_add(next_pc, offset) ? 2 : 1;
+        size_t taken_count = 0;
+        for (const auto lane : lanes) {
+            const bool taken = branch_taken(opcode_class, p[lane]);
+            pc[lane] = taken ? target : next_pc;
+            cycles[lane] += 2 + (taken ? taken_cycles : 0);
+            taken_count += taken ? 1 : 0;
+        }
+        diverged = taken_count != 0 && taken_count != std::ranges::size(lanes);
+        return true;
+    }
+
+    // Every lane reads its operand from the same offset in its own RAM
+    const auto operand = [&](const size_t lane) {
+        return mode == Mode::Immediate ? argument : lane_ram(lane)[argument];
+    };
+
+    switch (opcode_class) {
+        case OpcodeClass::CLC:
+        case OpcodeClass::SEC:
+            for (const auto lane : lanes) {
+                update_flag(p[lane], StatusFlag::Carry, opcode_class == OpcodeClass::SEC);
+            }
+            break;
+        case OpcodeClass::CLD:
+        case OpcodeClass::SED:
+            for (const auto lane : lanes) {
+                update_flag(p[lane], StatusFlag::Decimal, opcode_class == OpcodeClass::SED);
+            }
+            break;
+        case OpcodeClass::CLI:
+        case OpcodeClass::SEI:
+            for (const auto lane : lanes) {
+                update_flag(
+                    p[lane], StatusFlag::InterruptDisable, opcode_class == OpcodeClass::SEI
+                );
+            }
+            break;
+        case OpcodeClass::CLV:
+            for (const auto lane : lanes) {
+                update_flag(p[lane], StatusFlag::Overflow, false);
+            }
+            break;
+        case OpcodeClass::INX:
+            for (const auto lane : lanes) {
+                update_zero_negative(p[lane], ++x[lane]);
+            }
+            break;
+        case OpcodeClass::INY:
+            for (const auto lane : lanes) {
+                update_zero_negative(p[lane], ++y[lane]);
+            }
+            break;
+        case OpcodeClass::DEX:
+            for (const auto lane : lanes) {
+                update_zero_negative(p[lane], --x[lane]);
+            }
+            break;
+        case OpcodeClass::DEY:
+            for (const auto lane : lanes) {
+                update_zero_negative(p[lane], --y[lane]);
+            }
+            break;
+        case OpcodeClass::TAX:
+            for (const auto lane : lanes) {
+                x[lane] = a[lane];
+                update_zero_negative(p[lane], x[lane]);
+            }
+            break;
+        case OpcodeClass::TAY:
+            for (const auto lane : lanes) {
+                y[lane] = a[lane];
+                update_zero_negative(p[lane], y[lane]);
+            }
+            break;
+        case OpcodeClass::TSX:
+            for (const auto lane : lanes) {
+                x[lane] = s[lane];
+                update_zero_negative(p[lane], x[lane]);
+            }
+            break;
+        case OpcodeClass::TXA:
+            for (const auto lane : lanes) {
+                a[lane] = x[lane];
+                update_zero_negative(p[lane], a[lane]);
+            }
+            break;
+        case OpcodeClass::TXS:
+            for (const auto lane : lanes) {
+                s[lane] = x[lane];
+            }
+            break;
+        case OpcodeClass::TYA:
+            for (const auto lane : lanes) {
+                a[lane] = y[lane];
+                update_zero_negative(p[lane], a[lane]);
+            }
+            break;
+        case OpcodeClass::NOP:
+            break;
+        case OpcodeClass::LDA:
+            for (const auto lane : lanes) {
+                a[lane] = operand(lane);
+                update_zero_negative(p[lane], a[lane]);
+            }
+            break;
+        case OpcodeClass::LDX:
+            for (const auto lane : lanes) {
+                x[lane] = operand(lane);
+                update_zero_negative(p[lane], x[lane]);
+            }
+            break;
+        case OpcodeClass::LDY:
+            for (const auto lane : lanes) {
+                y[lane] = operand(lane);
+                update_zero_negative(p[lane], y[lane]);
+            }
+            break;
+        case OpcodeClass::AND:
+            for (const auto lane : lanes) {
+                a[lane] &= operand(lane);
+                update_zero_negative(p[lane], a[lane]);
+            }
+            break;
+        case OpcodeClass::ORA:
+            for (const auto lane : lanes) {
+                a[lane] |= operand(lane);
+                update_zero_negative(p[lane], a[lane]);
+            }
+            break;
+        case OpcodeClass::EOR:
+            for (const auto lane : lanes) {
+                a[lane] ^= operand(lane);
+                update_zero_negative(p[lane], a[lane]);
+            }
+            break;
+        case OpcodeClass::ADC:
+            for (const auto lane : lanes) {
+                add_with_carry(a[lane], p[lane], operand(lane));
+            }
+            break;
+        case OpcodeClass::SBC:
+            for (const auto lane : lanes) {
+                add_with_carry(a[lane], p[lane], operand(lane) ^ 0x00FF);
+            }
+            break;
+        case OpcodeClass::CMP:
+            for (const auto lane : lanes) {
+                compare(p[lane], a[lane], operand(lane));
+            }
+            break;
+        case OpcodeClass::CPX:
+            for (const auto lane : lanes) {
+                compare(p[lane], x[lane], operand(lane));
+            }
+            break;
+        case OpcodeClass::CPY:
+            for (const auto lane : lanes) {
+                compare(p[lane], y[lane], operand(lane));
+            }
+            break;
+        case OpcodeClass::BIT:
+            for (const auto lane : lanes) {
+                const byte value = operand(lane);
+                update_flag(p[lane], StatusFlag::Negative, (value & 0x80) != 0x00);
+                update_flag(p[lane], StatusFlag::Overflow, (value & 0x40) != 0x00);
+                update_flag(p[lane], StatusFlag::Zero, (value & a[lane]) == 0x00);
+            }
+            break;
+        case OpcodeClass::STA:
+            for (const auto lane : lanes) {
+                lane_ram(lane)[argument] = a[lane];
+            }
+            break;
+        case OpcodeClass::STX:
+            for (const auto lane : lanes) {
+                lane_ram(lane)[argument] = x[lane];
+            }
+            break;
+        case OpcodeClass::STY:
+            for (const auto lane : lanes) {
+                lane_ram(lane)[argument] = y[lane];
+            }
+            break;
+        default:
+            spdlog::error("Unreachable case");
+            std::exit(-1);
+    }
+
+    for (const auto lane : lanes) {
+        pc[lane] = next_pc;
+        cycles[lane] += opcode.cycles;
+    }
+
+    return true;
+}
+
+void BatchCpu::step_lane(const size_t lane) {
+    // The lines were polled during the last cycle of the previous instruction
+    catch_up_for_interrupts(lane);
+
+    auto& cpu = cpus[lane];
+    cpu.a = a[lane];
+    cpu.x = x[lane];
+    cpu.y = y[lane];
+    cpu.s = s[lane];
+    cpu.pc = pc[lane];
+    cpu.p = p[lane];
+
+    cpu.step();
+    scalar_instructions++;
+
+    a[lane] = cpu.a;
+    x[lane] = cpu.x;
+    y[lane] = cpu.y;
+    s[lane] = cpu.s;
+    pc[lane] = cpu.pc;
+    p[lane] = cpu.p;
+}
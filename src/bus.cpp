@@ -1,5 +1,6 @@
 #include "bus.hxx"
 
+#include "ppu_event_log.hxx"
 #include "util.hxx"
 
 byte Bus::cpu_read(const word address) const {
@@ -24,6 +25,7 @@ byte Bus::cpu_read(const word address) const {
 void Bus::cpu_write(const word address, const byte data) {
     if (InRange<word>(0x0000, address, 0x1FFF)) {
         internal_ram[address % 0x800] = data;
+        watched_ram_written |= address % 0x800 == watched_ram_address;
     } else if (InRange<word>(0x2000, address, 0x3FFF)) {
         ppu->CpuWrite(address, data);
     } else if (address == 0x4014) {
@@ -34,6 +36,11 @@ void Bus::cpu_write(const word address, const byte data) {
         controller->CpuWrite(address, data);
     } else if (InRange<word>(0x4018, address, 0x401F)) {
     } else {
+        if (address >= 0x8000) {
+            // Mapper registers can switch CHR banks and mirroring
+            ppu->FlushDeferredLine();
+            ppu->RecordEvent(PpuEventType::MapperWrite, address, data);
+        }
         cartridge->cpu_write(cycles, address, data);
     }
 }
@@ -1,23 +1,49 @@
 #include <memory>
-#include <vector>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 
 #include "mapper.hxx"
 #include "cartridge.hxx"
+#include "declarative_mapper.hxx"
 #include "constants.hxx"
+#include "rom_image.hxx"
 
-std::shared_ptr<Cartridge>
-init_mapper(RomHeader header, std::vector<byte>&& prg_rom, std::vector<byte>&& chr_rom) {
-    switch (header.mapper_number) { // TODO: Handle differences in iNES and NES2.0 headers
+std::shared_ptr<Cartridge> init_mapper(std::shared_ptr<const RomImage> image) {
+    switch (image->header.mapper_number) { // TODO: Handle differences in iNES and NES2.0 headers
         case 0x00:
             spdlog::info("Loading NROM mapper for cartridge");
-            return std::make_shared<Nrom>(header, std::move(prg_rom), std::move(chr_rom));
+            return std::make_shared<Nrom>(std::move(image));
         case 0x01:
             spdlog::info("Loading MMC1 mapper for cartridge");
-            return std::make_shared<Mmc1>(header, std::move(prg_rom), std::move(chr_rom));
+            return std::make_shared<Mmc1>(std::move(image));
+        case 0x02:
+            spdlog::info("Loading UxROM mapper for cartridge");
+            return std::make_shared<Uxrom>(std::move(image));
+        case 0x03:
+            spdlog::info("Loading CNROM mapper for cartridge");
+            return std::make_shared<Cnrom>(std::move(image));
+        case 0x04:
+            spdlog::info("Loading MMC3 mapper for cartridge");
+            return std::make_shared<Mmc3>(std::move(image));
+        case 0x07:
+            spdlog::info("Loading AxROM mapper for cartridge");
+            return std::make_shared<Axrom>(std::move(image));
+        case 0x0B:
+            spdlog::info("Loading Color Dreams mapper for cartridge");
+            return std::make_shared<ColorDreams>(std::move(image));
+        case 0x42:
+            spdlog::info("Loading GxROM mapper for cartridge");
+            return std::make_shared<Gxrom>(std::move(image));
+        case 0x47:
+            if (image->header.submapper == 1) {
+                spdlog::info("Loading Camerica (Fire Hawk) mapper for cartridge");
+                return std::make_shared<FireHawk>(std::move(image));
+            }
+            spdlog::info("Loading Camerica mapper for cartridge");
+            return std::make_shared<Camerica>(std::move(image));
         default:
-            spdlog::error("Cartridge requires not implemented mapper {}", header.mapper_number);
+            spdlog::error("Cartridge requires not implemented mapper {}", image->header.mapper_number);
             std::exit(-1);
     }
 }
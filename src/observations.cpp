@@ -0,0 +1,57 @@
+#include "observations.hxx"
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+
+#include "palette.hxx"
+
+void DownsampleLuma(
+    const PpuFramebuffer& framebuffer,
+    const std::span<byte> luma,
+    const size_t width,
+    const size_t height
+) {
+    if (width == 0 || height == 0 || width > NES_WIDTH || height > NES_HEIGHT
+        || luma.size() < width * height) {
+        spdlog::error(
+            "Cannot downsample the frame to {}x{} into {} bytes",
+            width,
+            height,
+            luma.size()
+        );
+        std::exit(-1);
+    }
+
+    // Sums of each column over the lines the current output row covers. 240 lines of 255 at most
+    std::array<uint16_t, NES_WIDTH> column_sums{};
+
+    for (size_t out_y = 0; out_y < height; out_y++) {
+        const size_t first_line = out_y * NES_HEIGHT / height;
+        const size_t end_line = (out_y + 1) * NES_HEIGHT / height;
+
+        // Every source pixel is looked up once, a whole line at a time
+        column_sums.fill(0);
+        for (size_t y = first_line; y < end_line; y++) {
+            const auto line = framebuffer.Line(y);
+            for (size_t x = 0; x < NES_WIDTH; x++) {
+                column_sums[x] += PALETTE_LUMA[line[x]];
+            }
+        }
+
+        auto* out = luma.data() + out_y * width;
+        for (size_t out_x = 0; out_x < width; out_x++) {
+            const size_t first_column = out_x * NES_WIDTH / width;
+            const size_t end_column = (out_x + 1) * NES_WIDTH / width;
+
+            uint32_t sum = 0;
+            for (size_t x = first_column; x < end_column; x++) {
+                sum += column_sums[x];
+            }
+            const uint32_t area = (end_column - first_column) * (end_line - first_line);
+            out[out_x] = (sum + area / 2) / area;
+        }
+    }
+}
@@ -2,216 +2,469 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <memory>
+#include <utility>
+
 #include "constants.hxx"
+#include "ppu_event_log.hxx"
+#include "ppu_output_pool.hxx"
 #include "util.hxx"
 
-void Ppu::Tick() {
-    TickCounters();
+namespace {
+constexpr size_t DOTS_PER_LINE = 341;
+
+// Work the PPU does on a dot, looked up by line type and dot instead of being worked out from
+// the scanline and dot every tick
+enum DotAction : uint16_t {
+    SetVblank = 1U << 0U, // Only on the first VBlank line
+    ClearVblank = 1U << 1U,
+    BackdropPixel = 1U << 2U, // Output a pixel with rendering disabled
+    StartLine = 1U << 3U,
+    RenderBackground = 1U << 4U, // Shift, fetch and output a pixel on visible lines
+    EvaluateSprites = 1U << 5U,
+    IncrementFineY = 1U << 6U,
+    CopyHorizontalScroll = 1U << 7U,
+    FetchSprite = 1U << 8U,
+    ComposeSprites = 1U << 9U,
+    FetchNextLineTiles = 1U << 10U,
+    CopyVerticalScroll = 1U << 11U,
+    FinishFrame = 1U << 12U, // The visible lines are done, wait for the output threads
+    PatternFetch = 1U << 13U, // A pattern fetch starts and A12 may rise
+};
+
+constexpr uint16_t RENDERING_ACTIONS = StartLine | RenderBackground | EvaluateSprites
+    | IncrementFineY | CopyHorizontalScroll | FetchSprite | ComposeSprites | FetchNextLineTiles
+    | CopyVerticalScroll | PatternFetch;
+
+// A12 has to stay low for this many dots before MMC3 counts it rising again. Between two pattern
+// fetches from the same table it is only low for 4 dots, and for 8 around the end of a line
+constexpr unsigned int A12_FILTER_DOTS = 10;
+// Dots where fetches first switch to the $1000 pattern table each line with 8x8 sprites, when
+// only the sprites or only the background use it
+constexpr unsigned int SPRITE_A12_RISE_DOT = 261;
+constexpr unsigned int BACKGROUND_A12_RISE_DOT = 325;
+constexpr unsigned int FIRST_PATTERN_FETCH_DOT = 5;
+
+constexpr auto DOT_ACTIONS = [] {
+    std::array<std::array<uint16_t, DOTS_PER_LINE>, 4> table{};
+    auto& visible = table[static_cast<size_t>(ScanlineType::Visible)];
+    auto& pre_render = table[static_cast<size_t>(ScanlineType::PreRender)];
+    auto& vblank = table[static_cast<size_t>(ScanlineType::VBlank)];
+
+    for (size_t dot = 1; dot <= 256; dot++) {
+        visible[dot] |= RenderBackground | BackdropPixel;
+        pre_render[dot] |= RenderBackground;
+    }
+    visible[1] |= StartLine;
+    visible[256] |= EvaluateSprites | IncrementFineY;
+    pre_render[256] |= IncrementFineY;
+    visible[257] |= CopyHorizontalScroll;
+    pre_render[257] |= CopyHorizontalScroll;
+    // The pattern of each sprite is fetched on the 6th of its 8 dots
+    for (size_t dot = 257 + 5; dot <= 320; dot += 8) {
+        visible[dot] |= FetchSprite;
+    }
+    visible[320] |= ComposeSprites;
+    for (size_t dot = 321; dot <= 336; dot++) {
+        visible[dot] |= FetchNextLineTiles;
+        pre_render[dot] |= FetchNextLineTiles;
+    }
+    for (size_t dot = 280; dot <= 304; dot++) {
+        pre_render[dot] |= CopyVerticalScroll;
+    }
+    // Each 8 dot fetch reads the pattern in its last 4, sprites are fetched on the pre-render line
+    // too
+    for (size_t dot = FIRST_PATTERN_FETCH_DOT; dot <= 336; dot += 8) {
+        visible[dot] |= PatternFetch;
+        pre_render[dot] |= PatternFetch;
+    }
+    table[static_cast<size_t>(ScanlineType::PostRender)][0] |= FinishFrame;
+    vblank[1] |= SetVblank;
+    pre_render[1] |= ClearVblank;
 
-    if (ShowBackground() || ShowSprites()) {
-        if (InRange<unsigned int>(0, scanline, POST_RENDER_SCANLINE - 1)
-            || scanline == PRE_RENDER_SCANLINE) {
-            // PPU is accessing memory
-            if (InRange<unsigned int>(1, line_cycles, 256)) {
-                ShiftShifters();
-                ReadNextTileData(line_cycles % 8);
-                if (scanline != PRE_RENDER_SCANLINE) {
-                    RenderPixel();
-                }
-            }
+    return table;
+}();
+} // namespace
 
-            if (line_cycles == 64 && scanline != PRE_RENDER_SCANLINE) {
-                // TODO: This is where the actual secondary OAM clear happens
-                // SecondaryOamClear();
-            }
+void Ppu::Tick(const uint64_t cpu_cycles) {
+    cpu_cycle = cpu_cycles;
+    TickCounters();
 
-            if (line_cycles == 256) {
-                // TODO: Do the secondary OAM clear here since we use the data structure when
-                // rendering
-                if (scanline != PRE_RENDER_SCANLINE) {
-                    SecondaryOamClear();
-                    EvaluateNextLineSprites();
-                }
-                FineYIncrement();
-            }
+    const uint16_t actions = DOT_ACTIONS[static_cast<size_t>(line_type)][line_cycles];
+    if (actions == 0) {
+        return;
+    }
 
-            if (line_cycles == 257) {
-                // hori(v) = hori(t)
-                v.as_scroll.coarse_x_scroll = t.as_scroll.coarse_x_scroll;
-                v.as_scroll.nametable_select =
-                    (v.as_scroll.nametable_select & 0b10) | (t.as_scroll.nametable_select & 0b01);
-            }
+    if (actions & FinishFrame) {
+        FinishOutput();
+        if (frame_end_callback && output_enabled) {
+            frame_end_callback(framebuffer);
+        }
+    }
 
-            if (InRange<unsigned int>(257, line_cycles, 320) && scanline != PRE_RENDER_SCANLINE) {
-                const size_t sprite_index = (line_cycles - 257) / 8;
-                const auto& sprite = sprite_index < secondary_oam.size()
-                    ? secondary_oam[sprite_index].second
-                    : Sprite{.y = 0xFF, .tile_index = 0xFF, .attribs = 0xFF, .x = 0xFF};
+    if ((actions & SetVblank) && scanline == VBLANK_START_SCANLINE) {
+        ppustatus |= 0x80;
+        status_changes++;
+        // Trigger NMI if enabled
+        if (NmiAtVBlank()) {
+            interrupts->RaiseNmi(cpu_cycle); // Trigger NMI in CPU
+        }
+    }
 
-                unsigned int offset_into_sprite;
-                if (sprite.FlipVertical()) {
-                    offset_into_sprite = SpriteHeight() - 1 - (scanline - sprite.y);
-                } else {
-                    offset_into_sprite = scanline - sprite.y;
-                }
+    // Reset Vblank and Sprite 0 flag before rendering starts for the next frame
+    if (actions & ClearVblank) {
+        ppustatus &= 0x1F;
+        status_changes++;
+    }
 
-                word line_pattern_table_addr;
-                if (SpriteHeight() == 16) {
-                    line_pattern_table_addr = (((sprite.tile_index & 0x01) ? 0x1000 : 0x0000)
-                                               | ((sprite.tile_index & ~0x01) << 4))
-                        + (offset_into_sprite >= 8 ? offset_into_sprite + 8 : offset_into_sprite);
-                } else {
-                    line_pattern_table_addr =
-                        ((sprite.tile_index << 4) | SpritePatternTableAddress())
-                        + offset_into_sprite;
-                }
+    if (!ShowBackground() && !ShowSprites()) {
+        if ((actions & BackdropPixel) && output_enabled) {
+            const byte pixel = PpuRead(0x3F00);
 
-                switch ((line_cycles - 257) % 8) {
-                    case 1:
-                    case 3:
-                        // TODO: Garbage nametable read here
-                        if (sprite_index < secondary_oam.size()) {
-                            scanline_sprites_tile_data[sprite_index] =
-                                ActiveSprite{.tile_lsb = 0x00, .tile_msb = 0x00};
-                        }
-                        break;
-                    case 5: {
-                        const auto data_ = PpuRead(line_pattern_table_addr);
-                        if (sprite_index < secondary_oam.size()) {
-                            scanline_sprites_tile_data[sprite_index].tile_lsb = data_;
-                        }
-                        break;
-                    }
-                    case 7: {
-                        const auto data_ = PpuRead(line_pattern_table_addr + 8);
-                        if (sprite_index < secondary_oam.size()) {
-                            scanline_sprites_tile_data[sprite_index].tile_msb = data_;
-                        }
-                        break;
-                    }
-                    default:
-                        break;
-                }
-            }
+            framebuffer.SetPixel(line_cycles - 1, scanline, pixel & 0x3F, Emphasis());
+        }
+        return;
+    }
 
-            if (InRange<unsigned int>(321, line_cycles, 336)) {
-                // Fetch first two tiles on next scanline
-                ShiftShifters();
-                ReadNextTileData(line_cycles % 8);
-            }
+    if ((actions & RENDERING_ACTIONS) == 0) {
+        return;
+    }
 
-            if (line_cycles == 338 || line_cycles == 340) {
-                // Unused nametable fetches
-                // PpuRead(0x2000 | (v.value & 0x0FFF));
-            }
+    // PPU is accessing memory
+    if (actions & StartLine) {
+        line_deferred = scanline_rendering && bg_window_shift == 0;
+        sprite_zero_hit_dot = line_deferred && SpriteZeroHitPending() ? PredictSpriteZeroHit() : 0;
+    }
 
-            if (scanline == PRE_RENDER_SCANLINE && InRange<unsigned int>(280, line_cycles, 304)) {
-                // vert(v) == vert(t) each tick
-                v.as_scroll.coarse_y_scroll(t.as_scroll.coarse_y_scroll());
-                v.as_scroll.fine_y_scroll = t.as_scroll.fine_y_scroll;
-                v.as_scroll.nametable_select =
-                    (v.as_scroll.nametable_select & 0b01) | (t.as_scroll.nametable_select & 0b10);
-            }
+    if (actions & RenderBackground) {
+        if (!line_deferred) {
+            RenderDot(line_cycles);
+        } else if (line_cycles == 256) {
+            RenderDeferredLine();
         }
-    } else {
-        if (InRange<unsigned int>(0, scanline, POST_RENDER_SCANLINE - 1)
-            && InRange<unsigned int>(1, line_cycles, 256)) {
-            const byte pixel = PpuRead(0x3F00);
+    }
 
-            const byte screen_y = scanline;
-            const byte screen_x = line_cycles - 1;
-            const byte emphasis_bits = static_cast<word>(ppumask & 0xE0) << 1;
+    if (actions & EvaluateSprites) {
+        // TODO: The actual secondary OAM clear happens at dot 64, do it here since we use the
+        // data structure when rendering
+        SecondaryOamClear();
+        EvaluateNextLineSprites();
+    }
 
-            framebuffer[screen_y * NES_WIDTH + screen_x] = emphasis_bits | (pixel & 0x3F);
-        }
+    if (actions & IncrementFineY) {
+        FineYIncrement();
+    }
+
+    if (actions & CopyHorizontalScroll) {
+        // hori(v) = hori(t)
+        v = (v & ~HORIZONTAL_SCROLL_MASK) | (t & HORIZONTAL_SCROLL_MASK);
+    }
+
+    if (actions & FetchSprite) {
+        FetchSpritePattern((line_cycles - 257) / 8);
     }
+
+    if (actions & ComposeSprites) {
+        ComposeSpriteLine();
+    }
+
+    if (actions & FetchNextLineTiles) {
+        // Fetch first two tiles on next scanline
+        ShiftBgWindow();
+        ReadNextTileData(line_cycles % 8);
+    }
+
+    if (actions & CopyVerticalScroll) {
+        // vert(v) == vert(t) each tick
+        v = (v & ~VERTICAL_SCROLL_MASK) | (t & VERTICAL_SCROLL_MASK);
+    }
+
+    if ((actions & PatternFetch) && a12_watched) {
+        WatchA12(line_cycles);
+    }
+}
+
+bool Ppu::PatternFetchA12(const unsigned int dot) const {
+    if (dot <= 256 || dot > 320) {
+        return BgPatternTableAddress() != 0;
+    }
+    if (SpriteHeight() == 8) {
+        return SpritePatternTableAddress() != 0;
+    }
+
+    // Slots without a sprite fetch tile $FF, which 8x16 sprites take from $1000
+    const size_t slot = (dot - 257) / 8;
+    if (line_type == ScanlineType::PreRender || slot >= secondary_oam_size) {
+        return true;
+    }
+    return (secondary_oam[slot].second.tile_index & 0x01) != 0;
+}
+
+void Ppu::WatchA12(const unsigned int dot) {
+    if (!PatternFetchA12(dot)) {
+        return;
+    }
+
+    const uint64_t dot_number =
+        (frame_count * SCANLINES_PER_FRAME + scanline) * PPU_CLOCK_CYCLES_PER_SCANLINE + dot;
+    if (dot_number - a12_low_since >= A12_FILTER_DOTS) {
+        cartridge->ppu_a12_rise(cpu_cycle);
+    }
+    // The fetch keeps A12 high for 4 dots
+    a12_low_since = dot_number + 4;
+}
+
+void Ppu::FetchSpritePattern(const size_t sprite_index) {
+    if (sprite_index >= secondary_oam_size) {
+        return;
+    }
+    const auto& sprite = secondary_oam[sprite_index].second;
+
+    unsigned int offset_into_sprite;
+    if (sprite.FlipVertical()) {
+        offset_into_sprite = SpriteHeight() - 1 - (scanline - sprite.y);
+    } else {
+        offset_into_sprite = scanline - sprite.y;
+    }
+
+    word line_pattern_table_addr;
+    if (SpriteHeight() == 16) {
+        line_pattern_table_addr =
+            (((sprite.tile_index & 0x01) ? 0x1000 : 0x0000) | ((sprite.tile_index & ~0x01) << 4))
+            + (offset_into_sprite >= 8 ? offset_into_sprite + 8 : offset_into_sprite);
+    } else {
+        line_pattern_table_addr =
+            ((sprite.tile_index << 4) | SpritePatternTableAddress()) + offset_into_sprite;
+    }
+
+    // Both bit planes come decoded in one go, already flipped if needed
+    const auto& row = cartridge->ppu_tile_row(line_pattern_table_addr);
+    scanline_sprites_tile_data[sprite_index].pixels =
+        sprite.FlipHorizontal() ? row.flipped : row.pixels;
 }
 
 void Ppu::FineYIncrement() { // Fine Y increment
-    if ((v.value & 0x7000) != 0x7000) {
-        v.value = (v.value + 0x1000) & 0x7FFF;
+    if ((v & FINE_Y_MASK) != FINE_Y_MASK) {
+        v = (v + 0x1000) & 0x7FFF;
     } else {
-        v.value &= ~0x7000;
-        byte y = v.as_scroll.coarse_y_scroll();
+        v &= ~FINE_Y_MASK;
+        byte y = CoarseY(v);
         if (y == 29) {
             y = 0;
-            v.value ^= 0x0800;
+            v ^= 0x0800;
         } else if (y == 31) {
             y = 0;
         } else {
             y += 1;
         }
-        v.as_scroll.coarse_y_scroll(y);
+        v = (v & ~COARSE_Y_MASK) | (y << 5);
     }
 }
 
-void Ppu::ShiftShifters() {
-    bg_pattern_msb_shift_reg <<= 1;
-    bg_pattern_lsb_shift_reg <<= 1;
-
-    bg_attrib_lsb_shift_reg <<= 1;
-    bg_attrib_lsb_shift_reg |= ((bg_attrib_latch & (1 << 0)) != 0);
+void Ppu::RenderDot(const unsigned int dot) {
+    ShiftBgWindow();
+    ReadNextTileData(dot % 8);
+    if (scanline != PRE_RENDER_SCANLINE) {
+        RenderPixel(dot - 1);
+    }
+}
 
-    bg_attrib_msb_shift_reg <<= 1;
-    bg_attrib_msb_shift_reg |= ((bg_attrib_latch & (1 << 1)) != 0);
+void Ppu::RenderPixel(const byte screen_x) { // Output pixels
+    const unsigned int window_index = bg_window_shift + fine_x;
+    ComposePixel(screen_x, window_index < bg_window.size() ? bg_window[window_index] : 0x00);
 }
 
-void Ppu::RenderPixel() { // Output pixels
-    const byte bg_pixel_msb = (bg_pattern_msb_shift_reg & (1 << (15 - fine_x))) ? 1 : 0;
-    const byte bg_pixel_lsb = (bg_pattern_lsb_shift_reg & (1 << (15 - fine_x))) ? 1 : 0;
-    const byte bg_pixel = (bg_pixel_msb << 1) | (bg_pixel_lsb);
+void Ppu::ComposePixel(const byte screen_x, const byte bg_palette_index) {
+    DetectSpriteZeroHit(screen_x, bg_palette_index);
 
-    const byte screen_x = line_cycles - 1;
-    const byte screen_y = scanline;
-    const word emphasis_bits = static_cast<word>(ppumask & 0xE0) << 1;
+    if (!output_enabled) {
+        return;
+    }
 
-    bool had_sprite_on_pixel = false;
-    bool rendered_sprite_on_pixel = false;
-    for (int i = static_cast<int>(secondary_oam.size()) - 1;
-         i >= 0 && !((screen_x < 8) && !ShowSpritesInLeft());
-         i--) {
-        const auto& [oam_index, sprite] = secondary_oam[i];
+    const byte palette_address =
+        PixelPaletteAddress(ppumask, screen_x, bg_palette_index, sprite_line[screen_x]);
+    framebuffer.SetPixel(screen_x, scanline, palette_table[palette_address] & 0x3F, Emphasis());
+}
 
-        if (screen_x < sprite.x || ((screen_x - sprite.x) >= 8)) {
-            continue;
+void Ppu::DetectSpriteZeroHit(const byte screen_x, const byte bg_palette_index) {
+    if ((screen_x < 8 && !ShowSpritesInLeft()) || (bg_palette_index & 0b11) == 0) {
+        return;
+    }
+
+    if (sprite_line[screen_x].sprite_zero && (ppustatus & 0x40) == 0x00) {
+        ppustatus |= 0x40;
+        status_changes++;
+    }
+}
+
+// Palette address of a pixel where the background and sprites are shown as given
+template<bool ShowBackground, bool ShowSprites>
+static byte ClippedPixelPaletteAddress(const byte bg_palette_index, const SpritePixel& sprite) {
+    if constexpr (!ShowBackground) {
+        return 0x00;
+    }
+    const byte bg_pixel = bg_palette_index & 0b11;
+    if constexpr (ShowSprites) {
+        if (sprite.palette_address != 0 && (!sprite.behind_background || bg_pixel == 0)) {
+            return sprite.palette_address;
         }
-        had_sprite_on_pixel = true;
+    }
+    return bg_pixel == 0 ? bg_pixel : bg_palette_index;
+}
 
-        auto [tile_lsb, tile_msb] = scanline_sprites_tile_data[i];
+byte Ppu::PixelPaletteAddress(
+    const byte ppumask,
+    const byte screen_x,
+    const byte bg_palette_index,
+    const SpritePixel& sprite
+) {
+    if (screen_x >= 8) {
+        return ClippedPixelPaletteAddress<true, true>(bg_palette_index, sprite);
+    }
+    if ((ppumask & 0x02) == 0x00) { // Background hidden in the left column
+        return ClippedPixelPaletteAddress<false, false>(bg_palette_index, sprite);
+    }
+    return (ppumask & 0x04) != 0x00
+        ? ClippedPixelPaletteAddress<true, true>(bg_palette_index, sprite)
+        : ClippedPixelPaletteAddress<true, false>(bg_palette_index, sprite);
+}
 
-        const auto sprite_pixel_index =
-            sprite.FlipHorizontal() ? (screen_x - sprite.x) : 7 - (screen_x - sprite.x);
-        const byte sp_pixel_msb = ((tile_msb & (1 << sprite_pixel_index)) != 0) ? 1 : 0;
-        const byte sp_pixel_lsb = ((tile_lsb & (1 << sprite_pixel_index)) != 0) ? 1 : 0;
-        const byte sp_pixel = (sp_pixel_msb << 1) | (sp_pixel_lsb);
+template<bool ShowBackgroundInLeft, bool ShowSpritesInLeft>
+static void ComposeLine(
+    const std::span<const byte, NES_WIDTH> background,
+    const std::span<const SpritePixel, NES_WIDTH> sprites,
+    const std::array<byte, 32>& palette_table,
+    const std::span<byte, NES_WIDTH> colors
+) {
+    size_t x = 0;
+    for (; x < 8; x++) {
+        const byte palette_address =
+            ClippedPixelPaletteAddress<ShowBackgroundInLeft, ShowSpritesInLeft>(
+                background[x],
+                sprites[x]
+            );
+        colors[x] = palette_table[palette_address] & 0x3F;
+    }
+    for (; x < NES_WIDTH; x++) {
+        const byte palette_address =
+            ClippedPixelPaletteAddress<true, true>(background[x], sprites[x]);
+        colors[x] = palette_table[palette_address] & 0x3F;
+    }
+}
 
-        if (((ppustatus & 0x40) == 0x00) && oam_index == 0 && sp_pixel != 0 && bg_pixel != 0) {
-            ppustatus |= 0x40;
-        }
+PpuLineKernel Ppu::LineKernel(const byte ppumask) {
+    static constexpr std::array<PpuLineKernel, 4> KERNELS{
+        ComposeLine<false, false>,
+        ComposeLine<true, false>,
+        ComposeLine<false, true>,
+        ComposeLine<true, true>,
+    };
+    return KERNELS[(ppumask >> 1) & 0b11];
+}
 
-        if (!sp_pixel || (sprite.BgOverSprite() && bg_pixel)) {
-            continue;
-        }
+void Ppu::RenderDeferredLine() {
+    line_deferred = false;
+
+    // Pixel `x` of the line is pixel `x + 1 + fine_x` of the window followed by the tiles fetched
+    // during the line. The line is only deferred while the window was just reloaded
+    constexpr size_t LINE_TILES = 34;
+    std::array<byte, LINE_TILES * 8> line_pixels{};
+    std::ranges::copy(bg_window, line_pixels.begin());
+
+    // Fetch the rest like the dot pipeline does every 8 dots
+    for (size_t tile = 2; tile < LINE_TILES; tile++) {
+        ReadNextTileData(2);
+        ReadNextTileData(4);
+        ReadNextTileData(6);
+        std::ranges::copy(LatchedTilePaletteIndices(), line_pixels.begin() + tile * 8);
+        CoarseXIncrement();
+    }
 
-        const byte sp_palette_offset = sprite.PaletteIndex() + 4;
-        const byte sp_palette_address = (sp_palette_offset << 2) | sp_pixel;
-        const byte sp_pixel_color_id = palette_table[sp_palette_address];
+    // Nothing touched the line since it started, so the predicted sprite 0 hit still holds
+    if (sprite_zero_hit_dot != 0 && SpriteZeroHitPending()) {
+        ppustatus |= 0x40;
+        status_changes++;
+    }
 
-        framebuffer[screen_y * NES_WIDTH + screen_x] = emphasis_bits | (sp_pixel_color_id & 0x3F);
-        rendered_sprite_on_pixel = true;
+    const std::span<const byte, NES_WIDTH> background{line_pixels.data() + 1 + fine_x, NES_WIDTH};
+    if (output_enabled && output_pool) {
+        auto& line = output_pool->NextLine();
+        line.scanline = scanline;
+        line.ppumask = ppumask;
+        line.palette_table = palette_table;
+        std::ranges::copy(background, line.background.begin());
+        line.sprites = sprite_line;
+        output_pool->Submit();
+    } else if (output_enabled) {
+        std::array<byte, NES_WIDTH> colors{};
+        line_kernel(background, sprite_line, palette_table, colors);
+        framebuffer.SetLine(scanline, colors, Emphasis());
     }
 
-    if ((!had_sprite_on_pixel && !bg_pixel) || ((screen_x < 8) && !ShowBackgroundInLeft())) {
-        framebuffer[screen_y * NES_WIDTH + screen_x] = emphasis_bits | (PpuRead(0x3F00) & 0x3F);
-    } else if (!rendered_sprite_on_pixel) {
-        const byte bg_attrib_msb = (bg_attrib_msb_shift_reg & (1 << (7 - fine_x))) ? 1 : 0;
-        const byte bg_attrib_lsb = (bg_attrib_lsb_shift_reg & (1 << (7 - fine_x))) ? 1 : 0;
-        const byte bg_palette_offset = (bg_attrib_msb << 1) | bg_attrib_lsb;
-        const byte bg_palette_address =
-            bg_pixel == 0 ? bg_pixel : (bg_palette_offset << 2) | bg_pixel;
-        const byte bg_pixel_color_id = palette_table[bg_palette_address];
+    // Leave the window how the dot pipeline would have after dot 256
+    std::copy_n(line_pixels.end() - bg_window.size(), bg_window.size(), bg_window.begin());
+    bg_window_shift = 0;
+}
+
+Ppu::Ppu() = default;
 
-        framebuffer[screen_y * NES_WIDTH + screen_x] = emphasis_bits | (bg_pixel_color_id & 0x3F);
+Ppu::Ppu(std::shared_ptr<Cartridge> cartridge, InterruptLines* interrupts) :
+    cartridge{std::move(cartridge)},
+    interrupts{interrupts} {
+    if (this->cartridge->header.hardware_mirroring == FourScreenVram) {
+        vram.resize(0x1000);
+    }
+    // The PPU clocks the mapper's IRQ counter, if it has one
+    this->cartridge->connect_interrupts(interrupts);
+    a12_watched = this->cartridge->watches_ppu_a12();
+}
+
+Ppu::~Ppu() {
+    // Stop drawing before the framebuffer goes away
+    output_pool.reset();
+}
+
+void Ppu::RecordEvent(const PpuEventType type, const word address, const byte value) const {
+    if (event_log != nullptr) {
+        event_log->Record(type, address, value);
+    }
+}
+
+void Ppu::SetOutputThreads(const size_t threads) {
+    if (threads == OutputThreads()) {
+        return;
+    }
+
+    output_pool.reset();
+    if (threads != 0) {
+        output_pool = std::make_unique<PpuOutputPool>(framebuffer, threads);
+    }
+}
+
+size_t Ppu::OutputThreads() const {
+    return output_pool ? output_pool->threads() : 0;
+}
+
+void Ppu::FinishOutput() const {
+    if (output_pool) {
+        output_pool->Finish();
+    }
+}
+
+size_t Ppu::MemoryFootprint() const {
+    return sizeof(Ppu) + vram.size() + (output_pool ? sizeof(PpuOutputPool) : 0);
+}
+
+void Ppu::FlushDeferredLine() {
+    if (!line_deferred) {
+        return;
+    }
+
+    // Run the dots the line skipped so far, then continue dot by dot
+    line_deferred = false;
+    for (unsigned int dot = 1; dot <= line_cycles; dot++) {
+        RenderDot(dot);
     }
 }
 
@@ -219,36 +472,18 @@ void Ppu::ReadNextTileData(const unsigned int cycle) {
     switch (cycle) { // 0, 1, ..., 7
         case 2:
             // Fetch NT byte
-            tile_id_latch = PpuRead(0x2000 | (v.value & 0x0FFF));
+            tile_id_latch = PpuRead(0x2000 | (v & 0x0FFF));
             break;
-        case 4: {
+        case 4:
             // Fetch AT byte
-            bg_attrib_data = PpuRead(
-                0x23C0 | (v.value & 0x0C00) | ((v.value >> 4) & 0x38) | ((v.value >> 2) & 0x07)
-            );
-            const byte coarse_x = v.as_scroll.coarse_x_scroll;
-            const byte coarse_y = v.as_scroll.coarse_y_scroll();
-            const byte left_or_right = (coarse_x / 2) % 2;
-            const byte top_or_bottom = (coarse_y / 2) % 2;
-            const byte offset = ((top_or_bottom << 1) | left_or_right) * 2;
-            bg_attrib_data = ((bg_attrib_data & (0b11 << offset)) >> offset) & 0b11;
+            bg_attrib_data = TileAttribute(v);
             break;
-        }
         case 6:
-            // Fetch BG ls bits
-            bg_pattern_lsb_latch = PpuRead(
-                BgPatternTableAddress() + (static_cast<word>(tile_id_latch) << 4)
-                + v.as_scroll.fine_y_scroll
-            );
+            // Fetch both BG bit planes, decoded into pixels
+            bg_tile_latch = cartridge->ppu_tile_row(TileRowAddress(tile_id_latch, v)).pixels;
             break;
         case 0:
-            // Fetch BG ms bits
-            bg_pattern_msb_latch = PpuRead(
-                BgPatternTableAddress() + (static_cast<word>(tile_id_latch) << 4)
-                + v.as_scroll.fine_y_scroll + 8
-            );
-
-            ReloadShiftersFromLatches();
+            ReloadBgWindow();
             CoarseXIncrement();
             break;
 
@@ -257,38 +492,189 @@ void Ppu::ReadNextTileData(const unsigned int cycle) {
     }
 }
 
-void Ppu::CoarseXIncrement() {
-    if ((v.value & 0x001F) == 31) {
-        v.value &= ~0x001F;
-        v.value ^= 0x0400;
+word Ppu::CoarseXIncremented(word address) {
+    if ((address & COARSE_X_MASK) == 31) {
+        address &= ~COARSE_X_MASK;
+        address ^= 0x0400;
     } else {
-        v.value = (v.value + 1) & 0x7FFF;
+        address = (address + 1) & 0x7FFF;
     }
+    return address;
 }
 
 void Ppu::SecondaryOamClear() {
-    secondary_oam.clear();
+    secondary_oam_size = 0;
 }
 
 void Ppu::EvaluateNextLineSprites() {
-    for (size_t i = 0; i < 64; i++) {
-        if (const auto& sprite = oam[i];
-            scanline >= sprite.y && ((scanline - sprite.y) < SpriteHeight())) {
-            if (secondary_oam.size() == 8) {
-                // TODO: Implement sprite overflow
-                break;
+    if (line_sprites_dirty) {
+        IndexLineSprites();
+    }
+
+    for (byte i = 0; i < line_sprite_counts[scanline]; i++) {
+        const auto oam_index = line_sprites[scanline][i];
+        secondary_oam[secondary_oam_size++] = {oam_index, oam[oam_index]};
+    }
+
+    if (line_sprite_overflows[scanline] && (ppustatus & 0x20) == 0x00) {
+        ppustatus |= 0x20;
+        status_changes++;
+    }
+}
+
+void Ppu::IndexLineSprites() {
+    line_sprite_counts.fill(0);
+
+    for (byte i = 0; i < oam.size(); i++) {
+        const unsigned int first_line = oam[i].y;
+        const unsigned int end_line =
+            std::min<unsigned int>(first_line + SpriteHeight(), line_sprites.size());
+        for (unsigned int line = first_line; line < end_line; line++) {
+            if (line_sprite_counts[line] < secondary_oam.size()) {
+                line_sprites[line][line_sprite_counts[line]++] = i;
+            }
+        }
+    }
+
+    line_sprite_overflows.reset();
+    for (unsigned int line = 0; line < line_sprites.size(); line++) {
+        if (line_sprite_counts[line] == secondary_oam.size()) {
+            line_sprite_overflows[line] = LineOverflows(line);
+        }
+    }
+
+    line_sprites_dirty = false;
+}
+
+bool Ppu::LineOverflows(const unsigned int line) const {
+    // Once 8 sprites are found the evaluation keeps looking for a 9th, but it also steps the byte
+    // it compares to the line on every miss, so it goes diagonally through OAM reading tile
+    // indices, attributes and X positions as Y coordinates
+    // https://www.nesdev.org/wiki/PPU_sprite_evaluation#Sprite_overflow_bug
+    const auto* bytes = reinterpret_cast<const byte*>(oam.data());
+    unsigned int m = 0;
+    for (unsigned int n = line_sprites[line].back() + 1U; n < oam.size(); n++) {
+        if (line - bytes[n * sizeof(Sprite) + m] < SpriteHeight()) {
+            return true;
+        }
+        m = (m + 1) % sizeof(Sprite);
+    }
+    return false;
+}
+
+void Ppu::ComposeSpriteLine() {
+    sprite_line.fill({});
+
+    // Lower OAM indices come first, so the first opaque pixel a sprite puts somewhere wins
+    for (size_t i = 0; i < secondary_oam_size; i++) {
+        const auto& [oam_index, sprite] = secondary_oam[i];
+        const auto& pixels = scanline_sprites_tile_data[i].pixels;
+        const byte palette_offset = sprite.PaletteIndex() + 4;
+
+        for (size_t x = 0; x < pixels.size() && sprite.x + x < NES_WIDTH; x++) {
+            if (pixels[x] == 0) {
+                continue;
+            }
+
+            auto& pixel = sprite_line[sprite.x + x];
+            pixel.sprite_zero |= oam_index == 0;
+            if (pixel.palette_address == 0) {
+                pixel.palette_address = (palette_offset << 2) | pixels[x];
+                pixel.behind_background = sprite.BgOverSprite();
+            }
+        }
+    }
+}
+
+byte Ppu::TileAttribute(const word address) {
+    const byte attribute = PpuRead(
+        0x23C0 | (address & NAMETABLE_MASK) | ((address >> 4) & 0x38) | ((address >> 2) & 0x07)
+    );
+    const byte left_or_right = (CoarseX(address) / 2) % 2;
+    const byte top_or_bottom = (CoarseY(address) / 2) % 2;
+    const byte offset = ((top_or_bottom << 1) | left_or_right) * 2;
+    return (attribute >> offset) & 0b11;
+}
+
+word Ppu::TileRowAddress(const byte tile_id, const word address) const {
+    return BgPatternTableAddress() + (static_cast<word>(tile_id) << 4) + FineY(address);
+}
+
+std::array<byte, 8> Ppu::FetchTilePaletteIndices(const word address) {
+    const byte tile_id = PpuRead(0x2000 | (address & 0x0FFF));
+    const byte attribute = TileAttribute(address) << 2;
+    const auto& pixels = cartridge->ppu_tile_row(TileRowAddress(tile_id, address)).pixels;
+
+    std::array<byte, 8> palette_indices{};
+    for (size_t i = 0; i < palette_indices.size(); i++) {
+        palette_indices[i] = attribute | pixels[i];
+    }
+    return palette_indices;
+}
+
+unsigned int Ppu::PredictSpriteZeroHit() {
+    // Only the background under sprite 0 matters. Like `RenderDeferredLine()`, pixel `x` is
+    // pixel `x + 1 + fine_x` of the window followed by the tiles fetched during the line, without
+    // touching `v` or the window
+    const byte sprite_x = secondary_oam.front().second.x;
+    std::array<byte, 8> tile{};
+    size_t fetched_tile = 0;
+    for (unsigned int x = sprite_x; x < std::min<unsigned int>(sprite_x + 8, NES_WIDTH); x++) {
+        if (!sprite_line[x].sprite_zero || (x < 8 && !ShowSpritesInLeft())) {
+            continue;
+        }
+
+        const size_t window_index = x + 1 + fine_x;
+        byte bg_palette_index;
+        if (window_index < bg_window.size()) {
+            bg_palette_index = bg_window[window_index];
+        } else {
+            const size_t line_tile = window_index / 8;
+            if (line_tile != fetched_tile) {
+                word address = v;
+                for (size_t i = 2; i < line_tile; i++) {
+                    address = CoarseXIncremented(address);
+                }
+                tile = FetchTilePaletteIndices(address);
+                fetched_tile = line_tile;
             }
-            secondary_oam.emplace_back(i, sprite);
+            bg_palette_index = tile[window_index % 8];
+        }
+
+        if ((bg_palette_index & 0b11) != 0) {
+            return x + 1; // Pixel x is drawn on dot x + 1
         }
     }
-    scanline_sprites_tile_data.resize(secondary_oam.size());
+    return 0;
 }
 
-void Ppu::ReloadShiftersFromLatches() {
-    bg_pattern_msb_shift_reg |= bg_pattern_msb_latch;
-    bg_pattern_lsb_shift_reg |= bg_pattern_lsb_latch;
+std::array<byte, 8> Ppu::LatchedTilePaletteIndices() const {
+    std::array<byte, 8> palette_indices{};
+    const byte attribute = bg_attrib_data << 2;
+    for (size_t i = 0; i < palette_indices.size(); i++) {
+        palette_indices[i] = attribute | bg_tile_latch[i];
+    }
+    return palette_indices;
+}
 
-    bg_attrib_latch = bg_attrib_data;
+void Ppu::ReloadBgWindow() {
+    const auto tile = LatchedTilePaletteIndices();
+    if (bg_window_shift == 8) {
+        // Every dot since the last reload shifted the window, so the lower half is now empty
+        std::copy_n(bg_window.begin() + 8, 8, bg_window.begin());
+        std::ranges::copy(tile, bg_window.begin() + 8);
+    } else {
+        // Rendering was switched on or off in between. The shift registers would have shifted
+        // by fewer or more pixels and have the new bit planes ORed into what is left
+        for (size_t i = 0; i < bg_window.size(); i++) {
+            const size_t from = i + bg_window_shift;
+            bg_window[i] = from < bg_window.size() ? bg_window[from] : 0x00;
+        }
+        for (size_t i = 0; i < tile.size(); i++) {
+            bg_window[8 + i] = (tile[i] & 0b1100) | ((bg_window[8 + i] | tile[i]) & 0b11);
+        }
+    }
+    bg_window_shift = 0;
 }
 
 void Ppu::TickCounters() {
@@ -308,30 +694,130 @@ void Ppu::TickCounters() {
         if (scanline == SCANLINES_PER_FRAME) {
             frame_count++;
             scanline = 0;
+            if (event_log != nullptr) {
+                event_log->StartFrame();
+            }
+        }
+
+        if (scanline < POST_RENDER_SCANLINE) {
+            line_type = ScanlineType::Visible;
+        } else if (scanline == POST_RENDER_SCANLINE) { // The PPU idles during the post-render line
+            line_type = ScanlineType::PostRender;
+        } else if (scanline == PRE_RENDER_SCANLINE) {
+            line_type = ScanlineType::PreRender;
+        } else {
+            line_type = ScanlineType::VBlank;
         }
     }
+}
 
-    if (scanline == POST_RENDER_SCANLINE) { // The PPU idles during the post-render line
-        return;
+unsigned int
+Ppu::DotsUntil(const unsigned int target_scanline, const unsigned int target_cycle) const {
+    const unsigned int current = scanline * PPU_CLOCK_CYCLES_PER_SCANLINE + line_cycles;
+    unsigned int target = target_scanline * PPU_CLOCK_CYCLES_PER_SCANLINE + target_cycle;
+    if (target <= current) {
+        target += SCANLINES_PER_FRAME * PPU_CLOCK_CYCLES_PER_SCANLINE;
     }
+    return target - current;
+}
 
-    if (scanline == VBLANK_START_SCANLINE && line_cycles == VBLANK_SET_RESET_CYCLE) {
-        ppustatus |= 0x80;
-        // Trigger NMI if enabled
-        if (NmiAtVBlank()) {
-            *nmi_requested = true; // Trigger NMI in CPU
+unsigned int Ppu::DotsUntilNextStatusEvent(const bool status_polled) const {
+    // VBlank start also raises NMI so it always counts
+    unsigned int dots = DotsUntil(VBLANK_START_SCANLINE, VBLANK_SET_RESET_CYCLE);
+    if (!status_polled) {
+        return dots;
+    }
+
+    dots = std::min(dots, DotsUntil(PRE_RENDER_SCANLINE, VBLANK_SET_RESET_CYCLE));
+
+    // Sprite overflow is set when the evaluation at the end of an overflowing line gets to it
+    if ((ShowBackground() || ShowSprites()) && (ppustatus & 0x20) == 0x00) {
+        const unsigned int next_line =
+            scanline < POST_RENDER_SCANLINE ? scanline + (line_cycles >= NES_WIDTH ? 1 : 0) : 0;
+        for (unsigned int line = next_line; line < POST_RENDER_SCANLINE; line++) {
+            // Indices out of date may overflow anywhere once rebuilt
+            if (line_sprites_dirty || line_sprite_overflows[line]) {
+                dots = std::min(dots, DotsUntil(line, NES_WIDTH));
+                break;
+            }
         }
     }
 
-    // Reset Vblank and Sprite 0 flag before rendering starts for the next frame
-    if (scanline == PRE_RENDER_SCANLINE && line_cycles == VBLANK_SET_RESET_CYCLE) {
-        ppustatus &= 0x1F;
+    // Sprite 0 hit can only happen on the lines sprite 0 is drawn on
+    if ((ShowBackground() || ShowSprites()) && (ppustatus & 0x40) == 0x00) {
+        const unsigned int first_line = oam[0].y + 1;
+        const unsigned int last_line = oam[0].y + SpriteHeight();
+        if (first_line < POST_RENDER_SCANLINE) {
+            if (InRange(first_line, scanline, last_line)) {
+                // A deferred line already knows its hit, one drawn dot by dot could hit on any dot
+                if (line_deferred && sprite_zero_hit_dot != 0) {
+                    return line_cycles >= sprite_zero_hit_dot
+                        ? 0
+                        : std::min(dots, DotsUntil(scanline, sprite_zero_hit_dot));
+                }
+                if (line_cycles == 0 || (!line_deferred && line_cycles <= NES_WIDTH)) {
+                    return 0;
+                }
+                return std::min(dots, DotsUntil(scanline + 1, 1));
+            }
+            dots = std::min(dots, DotsUntil(first_line, 0));
+        }
+    }
+
+    return dots;
+}
+
+std::optional<unsigned int> Ppu::DotsUntilMapperIrq() const {
+    const auto rises = a12_watched ? cartridge->a12_rises_until_irq() : std::nullopt;
+    if (!rises || (!ShowBackground() && !ShowSprites())) {
+        return std::nullopt;
+    }
+    if (SpriteHeight() == 16) {
+        return 0; // Where A12 rises depends on the sprites of every line, not worked out
+    }
+
+    const bool background_high = BgPatternTableAddress() != 0;
+    const bool sprites_high = SpritePatternTableAddress() != 0;
+    if (!background_high && !sprites_high) {
+        return std::nullopt;
+    }
+
+    // Once on every line that fetches patterns where they switch to the $1000 table, unless both
+    // use it. The background also rises on the first fetch of the pre-render line, after A12
+    // stayed low through VBlank
+    unsigned int rise_dot = 0;
+    if (!background_high) {
+        rise_dot = SPRITE_A12_RISE_DOT;
+    } else if (!sprites_high) {
+        rise_dot = BACKGROUND_A12_RISE_DOT;
+    }
+    unsigned int remaining = *rises;
+    unsigned int line = scanline;
+    unsigned int from_dot = line_cycles; // Rises up to here already happened
+    for (unsigned int lines_ahead = 0;; lines_ahead++) {
+        const unsigned int line_start = lines_ahead * PPU_CLOCK_CYCLES_PER_SCANLINE;
+        if (background_high && line == PRE_RENDER_SCANLINE && from_dot < FIRST_PATTERN_FETCH_DOT
+            && --remaining == 0) {
+            return line_start + FIRST_PATTERN_FETCH_DOT - line_cycles;
+        }
+        if ((line < POST_RENDER_SCANLINE || line == PRE_RENDER_SCANLINE) && from_dot < rise_dot
+            && --remaining == 0) {
+            return line_start + rise_dot - line_cycles;
+        }
+        line = (line + 1) % SCANLINES_PER_FRAME;
+        from_dot = 0;
     }
 }
 
 byte Ppu::CpuRead(const word address) {
     switch (0x2000 + (address & 0b111)) {
         case 0x2002:
+            // A deferred line knows when sprite 0 hits, so it doesn't need to be drawn up to here
+            if (line_deferred && sprite_zero_hit_dot != 0 && line_cycles >= sprite_zero_hit_dot
+                && (ppustatus & 0x40) == 0x00) {
+                ppustatus |= 0x40;
+                status_changes++;
+            }
             io_data_bus = (ppustatus & 0xE0) | (io_data_bus & 0x1F);
             ppustatus &= 0x7F; // Reading this register clears bit 7
             write_toggle = false;
@@ -341,6 +827,7 @@ byte Ppu::CpuRead(const word address) {
             io_data_bus = reinterpret_cast<byte*>(oam.data())[oamaddr];
             break;
         case 0x2007:
+            FlushDeferredLine();
             // https://www.nesdev.org/wiki/PPU_scrolling#$2007_reads_and_writes
             if ((ShowBackground() || ShowSprites())
                 && (InRange<unsigned>(0, scanline, POST_RENDER_SCANLINE - 1)
@@ -349,7 +836,7 @@ byte Ppu::CpuRead(const word address) {
                 FineYIncrement();
                 io_data_bus = 0x00;
             } else {
-                if (const auto ppu_address = v.value & 0x3FFF;
+                if (const auto ppu_address = v & 0x3FFF;
                     ppu_address >= 0x3F00) { // Reading palettes
                     io_data_bus = PpuRead(ppu_address);
                 } else {
@@ -359,17 +846,20 @@ byte Ppu::CpuRead(const word address) {
                     }
                     ppudata_buf.emplace(PpuRead(ppu_address));
                 }
-                v.value = (v.value + VramAddressIncrement()) & 0x7FFF;
+                v = (v + VramAddressIncrement()) & 0x7FFF;
             }
             break;
         default:
             break;
     }
 
+    RecordEvent(PpuEventType::RegisterRead, 0x2000 + (address & 0b111), io_data_bus);
     return io_data_bus;
 }
 
 void Ppu::CpuWrite(word address, byte data) {
+    RecordEvent(PpuEventType::RegisterWrite, 0x2000 + (address & 0b111), data);
+    FlushDeferredLine();
     io_data_bus = data;
     switch (0x2000 + (address & 0b111)) {
         case 0x2000:
@@ -378,43 +868,48 @@ void Ppu::CpuWrite(word address, byte data) {
                 && ((ppuctrl & 0x80) != 0x00) // and changing the NMI flag in PPUCTRL from 0
                 && ((data & 0x80) == 0x80)) // to 1
             {
-                *nmi_requested = true; // will immediately generate an NMI
+                interrupts->RaiseNmi(cpu_cycle); // will immediately generate an NMI
+            }
+            if (((ppuctrl ^ data) & 0x20) != 0x00) {
+                line_sprites_dirty = true; // Sprite height changed
             }
             ppuctrl = data;
-            t.as_scroll.nametable_select = data & 0b11;
+            t = (t & ~NAMETABLE_MASK) | ((data & 0b11) << 10);
             break;
         case 0x2001:
             ppumask = data;
+            line_kernel = LineKernel(ppumask);
             break;
         case 0x2003:
             oamaddr = data;
             break;
         case 0x2004:
             reinterpret_cast<byte*>(oam.data())[oamaddr++] = data;
+            line_sprites_dirty = true;
             break;
         case 0x2005:
             if (write_toggle) { // Second Write
-                t.as_scroll.fine_y_scroll = data & 0b111;
-                t.as_scroll.coarse_y_scroll((data & 0xF8) >> 3);
+                t = (t & ~(FINE_Y_MASK | COARSE_Y_MASK)) | ((data & 0b111) << 12)
+                    | ((data & 0xF8) << 2);
             } else { // First Write
                 fine_x = data & 0b111;
-                t.as_scroll.coarse_x_scroll = (data & 0xF8) >> 3;
+                t = (t & ~COARSE_X_MASK) | (data >> 3);
             }
             write_toggle = !write_toggle;
             break;
         case 0x2006:
             // Might need to be delayed by 3 cycles
             if (write_toggle) { // Second Write
-                t.as_bytes.low = data;
-                v.value = t.value;
+                t = (t & 0xFF00) | data;
+                v = t;
             } else { // First Write
-                t.as_bytes.high = data & 0x3F;
+                t = (t & 0x00FF) | ((data & 0x3F) << 8);
             }
             write_toggle = !write_toggle;
             break;
         case 0x2007:
-            PpuWrite(v.value, data);
-            v.value = (v.value + VramAddressIncrement()) & 0x7FFF;
+            PpuWrite(v, data);
+            v = (v + VramAddressIncrement()) & 0x7FFF;
             break;
         default:
             spdlog::debug(
@@ -425,12 +920,12 @@ void Ppu::CpuWrite(word address, byte data) {
     }
 }
 
-byte Ppu::PpuRead(word address) const {
+byte Ppu::PpuRead(word address) {
     address &= 0x3FFF;
     if (InRange<word>(0x0000, address, 0x1FFF)) {
         return cartridge->ppu_read(address);
     } else if (InRange<word>(0x2000, address, 0x2FFF)) {
-        return vram.at(VramIndex(address));
+        return Nametable(address);
     } else if (InRange<word>(0x3000, address, 0x3EFF)) {
         return PpuRead(address - 0x1000);
     } else if (InRange<word>(0x3F00, address, 0x3FFF)) {
@@ -444,7 +939,7 @@ void Ppu::PpuWrite(word address, const byte data) {
     if (InRange<word>(0x0000, address, 0x1FFF)) {
         cartridge->ppu_write(address, data);
     } else if (InRange<word>(0x2000, address, 0x2FFF)) {
-        vram.at(VramIndex(address)) = data;
+        Nametable(address) = data;
     } else if (InRange<word>(0x3000, address, 0x3EFF)) {
         PpuWrite(address - 0x1000, data);
     } else if (InRange<word>(0x3F00, address, 0x3FFF)) {
@@ -455,16 +950,28 @@ void Ppu::PpuWrite(word address, const byte data) {
     }
 }
 
-size_t Ppu::VramIndex(const word address) const {
+void Ppu::MapNametables() {
+    std::array<size_t, 4> pages{};
     switch (cartridge->mirroring()) {
         case Horizontal:
-            return ((address >> 1) & 0x400) | (address & 0x3FF);
+            pages = {0, 0, 1, 1};
+            break;
         case Vertical:
-            return address & 0x7FF;
+            pages = {0, 1, 0, 1};
+            break;
         case FourScreenVram:
-            // TODO Four Screen Mirroring
+            pages = {0, 1, 2, 3};
+            break;
+        case SingleScreenLower:
+            pages = {0, 0, 0, 0};
             break;
+        case SingleScreenUpper:
+            pages = {1, 1, 1, 1};
+            break;
+    }
+
+    for (size_t i = 0; i < nametable_pages.size(); i++) {
+        nametable_pages[i] = vram.data() + pages[i] * 0x400;
     }
-    spdlog::error("Unknown mirroring option");
-    return address - 0x2000;
+    mapped_nametable_generation = cartridge->nametable_generation();
 }
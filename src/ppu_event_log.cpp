@@ -0,0 +1,32 @@
+#include "ppu_event_log.hxx"
+
+#include "interrupts.hxx"
+#include "ppu.hxx"
+
+void PpuEventLog::Record(const PpuEventType type, const word address, const byte value) {
+    if (paused) {
+        return;
+    }
+    if (current.size() == CAPACITY) {
+        current_dropped++;
+        return;
+    }
+
+    current.push_back({
+        .type = type,
+        .value = value,
+        .address = address,
+        .pc = program_counter(),
+        .scanline = static_cast<uint16_t>(ppu.Scanline()),
+        .dot = static_cast<uint16_t>(ppu.LineCycles()),
+        .frame = ppu.frame_count,
+    });
+}
+
+void InterruptLines::RecordNmi() const {
+    event_log->Record(PpuEventType::Nmi, 0x0000, 0x00);
+}
+
+void InterruptLines::RecordIrq(const IrqSource source) const {
+    event_log->Record(PpuEventType::Irq, 0x0000, static_cast<byte>(source));
+}
@@ -0,0 +1,84 @@
+#include "ppu_output_pool.hxx"
+
+#include <algorithm>
+#include <array>
+
+#include "constants.hxx"
+#include "ppu.hxx"
+
+PpuOutputPool::PpuOutputPool(PpuFramebuffer& framebuffer, const size_t threads) :
+    framebuffer{framebuffer},
+    worker_count{std::max<size_t>(threads, 1)},
+    workers{std::make_unique<Worker[]>(worker_count)} {
+    for (size_t i = 0; i < worker_count; i++) {
+        workers[i].next.store(i, std::memory_order_relaxed);
+        workers[i].thread = std::thread{[this, i] { Run(i); }};
+    }
+}
+
+PpuOutputPool::~PpuOutputPool() {
+    Finish();
+    stopping.store(true, std::memory_order_relaxed);
+    // Wakes the workers up even if they are waiting for a line
+    submitted.fetch_add(1, std::memory_order_release);
+    submitted.notify_all();
+    for (size_t i = 0; i < worker_count; i++) {
+        workers[i].thread.join();
+    }
+}
+
+PpuLine& PpuOutputPool::NextLine() {
+    const auto next = submitted.load(std::memory_order_relaxed);
+    if (next >= RING_SIZE) {
+        // The slot still holds the line from one lap ago until its worker is past it
+        const auto previous = next - RING_SIZE;
+        const auto& worker = workers[previous % worker_count];
+        for (auto done = worker.next.load(std::memory_order_acquire); done <= previous;
+             done = worker.next.load(std::memory_order_acquire)) {
+            worker.next.wait(done, std::memory_order_acquire);
+        }
+    }
+    return lines[next % RING_SIZE];
+}
+
+void PpuOutputPool::Submit() {
+    submitted.fetch_add(1, std::memory_order_release);
+    submitted.notify_all();
+}
+
+void PpuOutputPool::Finish() const {
+    const auto target = submitted.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < worker_count; i++) {
+        const auto& worker = workers[i];
+        for (auto done = worker.next.load(std::memory_order_acquire); done < target;
+             done = worker.next.load(std::memory_order_acquire)) {
+            worker.next.wait(done, std::memory_order_acquire);
+        }
+    }
+}
+
+void PpuOutputPool::Run(const size_t worker_index) {
+    auto& worker = workers[worker_index];
+    uint64_t next = worker_index;
+    while (true) {
+        const auto available = submitted.load(std::memory_order_acquire);
+        if (stopping.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (next >= available) {
+            submitted.wait(available, std::memory_order_acquire);
+            continue;
+        }
+
+        for (; next < available; next += worker_count) {
+            const auto& line = lines[next % RING_SIZE];
+            std::array<byte, NES_WIDTH> colors{};
+            const auto kernel = Ppu::LineKernel(line.ppumask);
+            kernel(line.background, line.sprites, line.palette_table, colors);
+            framebuffer.SetLine(line.scanline, colors, line.ppumask >> 5);
+
+            worker.next.store(next + worker_count, std::memory_order_release);
+            worker.next.notify_all();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#include "rom_image.hxx"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "constants.hxx"
+
+RomImage::RomImage(
+    const RomHeader& header,
+    std::vector<byte>&& prg_rom,
+    std::vector<byte>&& chr_rom
+) :
+    header{header},
+    prg_rom{std::move(prg_rom)},
+    chr_rom{std::move(chr_rom)},
+    chr_tiles{this->chr_rom.size()} {
+    chr_tiles.decode_all(this->chr_rom);
+}
+
+RomImageCache& RomImageCache::global() {
+    static RomImageCache cache;
+    return cache;
+}
+
+std::shared_ptr<const RomImage> RomImageCache::get(
+    const RomHeader& header,
+    const std::span<const byte> prg_rom,
+    const std::span<const byte> chr_rom
+) {
+    const std::scoped_lock lock{mutex};
+    drop_expired();
+
+    for (const auto& cached : images) {
+        auto image = cached.lock();
+        if (image && image->header == header && std::ranges::equal(image->prg_rom, prg_rom)
+            && std::ranges::equal(image->chr_rom, chr_rom)) {
+            return image;
+        }
+    }
+
+    auto image = std::make_shared<const RomImage>(
+        header,
+        std::vector<byte>(prg_rom.begin(), prg_rom.end()),
+        std::vector<byte>(chr_rom.begin(), chr_rom.end())
+    );
+    images.emplace_back(image);
+    return image;
+}
+
+size_t RomImageCache::size() {
+    const std::scoped_lock lock{mutex};
+    drop_expired();
+    return images.size();
+}
+
+void RomImageCache::drop_expired() {
+    std::erase_if(images, [](const auto& image) { return image.expired(); });
+}
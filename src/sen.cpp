@@ -6,7 +6,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -17,19 +20,19 @@
 #include "controller.hxx"
 #include "cpu.hxx"
 #include "mapper.hxx"
+#include "observations.hxx"
 #include "ppu.hxx"
+#include "ppu_event_log.hxx"
+#include "rom_image.hxx"
 
-Sen::Sen(const RomArgs& rom_args, const std::shared_ptr<AudioQueue>& sink) {
-    nmi_requested = std::make_shared<bool>(false);
-    irq_requested = std::make_shared<bool>(false);
-
-    auto cartridge = ParseRomFile(rom_args);
-    ppu = std::make_shared<Ppu>(cartridge, nmi_requested);
-    apu = std::make_shared<Apu>(sink, irq_requested);
+Sen::Sen(const RomArgs& rom_args, const std::shared_ptr<AudioQueue>& sink) :
+    cartridge{ParseRomFile(rom_args)} {
+    ppu = std::make_shared<Ppu>(cartridge, &interrupts);
+    apu = std::make_shared<Apu>(sink, &interrupts);
     controller = std::make_shared<Controller>();
 
-    bus = std::make_shared<Bus>(std::move(cartridge), ppu, apu, controller);
-    cpu = Cpu<Bus>(bus, nmi_requested, irq_requested);
+    bus = std::make_shared<Bus>(cartridge, ppu, apu, controller);
+    cpu = Cpu<Bus>(bus, &interrupts);
 }
 
 void Sen::RunForCycles(const uint64_t cycles) {
@@ -43,6 +46,9 @@ void Sen::RunForCycles(const uint64_t cycles) {
 
     while (bus->cycles < target_cycles) {
         cpu.step();
+        if (idle_loop_skipping) {
+            SkipIdleLoop(target_cycles);
+        }
     }
 
     carry_over_cycles = bus->cycles - target_cycles;
@@ -57,41 +63,194 @@ void Sen::StepOpcode() {
     cpu.step();
 }
 
-void Sen::RunForOneScanline() {
+StopReason Sen::RunUntil(const StopConditions& conditions) {
     if (!running) {
         running = true;
         cpu.start();
     }
 
-    const auto ppu_start_scanline = ppu->Scanline();
+    const auto start_cycles = bus->cycles;
+    const auto end_cycles =
+        conditions.cycles ? start_cycles + *conditions.cycles : std::numeric_limits<uint64_t>::max();
+    bus->watch_ram_writes(conditions.ram_write);
 
-    cpu.step();
-    while (ppu->Scanline() == ppu_start_scanline) {
+    const auto stop = [this](const StopReason reason) {
+        bus->watch_ram_writes(std::nullopt);
+        return reason;
+    };
+
+    // Whether the instruction just run got to `target` on its way from `previous` to `current`.
+    // OAM DMA and idle loop skipping may move several lines past it
+    const auto lines = ppu->SCANLINES_PER_FRAME;
+    const auto reached = [lines](unsigned int previous, unsigned int current, unsigned int target) {
+        const auto ahead = (target + lines - previous) % lines;
+        return ahead != 0 && ahead <= (current + lines - previous) % lines;
+    };
+
+    auto scanline = ppu->Scanline();
+    while (true) {
         cpu.step();
+
+        if (conditions.jam && cpu.jammed()) {
+            return stop(StopReason::Jam);
+        }
+        if (conditions.ram_write && bus->take_watched_ram_write()) {
+            return stop(StopReason::RamWrite);
+        }
+        const auto previous = scanline;
+        scanline = ppu->Scanline();
+        if (previous != scanline) {
+            if (conditions.frame_end && reached(previous, scanline, ppu->POST_RENDER_SCANLINE)) {
+                return stop(StopReason::FrameEnd);
+            }
+            if (conditions.scanline && reached(previous, scanline, *conditions.scanline)) {
+                return stop(StopReason::Scanline);
+            }
+        }
+        if (conditions.breakpoint && cpu.program_counter() == *conditions.breakpoint) {
+            return stop(StopReason::Breakpoint);
+        }
+        if (bus->cycles >= end_cycles) {
+            return stop(StopReason::Cycles);
+        }
+
+        if (idle_loop_skipping && !conditions.breakpoint && !conditions.ram_write) {
+            // Stop skipping at the scanlines waited for so they are seen
+            auto target_cycles = end_cycles;
+            if (conditions.frame_end) {
+                target_cycles = std::min(
+                    target_cycles,
+                    bus->cycles + ppu->DotsUntilScanline(ppu->POST_RENDER_SCANLINE) / 3
+                );
+            }
+            if (conditions.scanline) {
+                target_cycles = std::min(
+                    target_cycles,
+                    bus->cycles + ppu->DotsUntilScanline(*conditions.scanline) / 3
+                );
+            }
+            SkipIdleLoop(target_cycles);
+        }
     }
 }
 
-void Sen::RunForOneFrame() {
+void Sen::RunForOneScanline() {
+    RunUntil({.scanline = (ppu->Scanline() + 1) % ppu->SCANLINES_PER_FRAME, .jam = false});
+}
+
+void Sen::RunForOneFrame(const bool render) {
     if (!running) {
         running = true;
         cpu.start();
     }
+    ppu->SetOutputEnabled(render);
 
     const auto cpu_cycles = bus->cycles;
     const auto target_cycles = cpu_cycles + CYCLES_PER_FRAME - carry_over_cycles;
 
     while (bus->cycles < target_cycles) {
         cpu.step();
+        if (idle_loop_skipping) {
+            SkipIdleLoop(target_cycles);
+        }
     }
 
     carry_over_cycles = bus->cycles - target_cycles;
+    ppu->SetOutputEnabled(true);
+}
+
+void Sen::SetIdleLoopSkipping(const bool enabled) {
+    idle_loop_skipping = enabled;
+    cpu.set_idle_loop_detection(enabled);
+}
+
+void Sen::SetEventLogging(const bool enabled) {
+    if (enabled == EventLogging()) {
+        return;
+    }
+
+    auto log = enabled
+        ? std::make_unique<PpuEventLog>(*ppu, [this] { return cpu.instruction_pc(); })
+        : nullptr;
+    ppu->SetEventLog(log.get());
+    interrupts.event_log = log.get();
+    event_log = std::move(log);
+}
+
+void Sen::SkipIdleLoop(const uint64_t target_cycles) {
+    if (ppu->frame_count != idle_stats_frame) {
+        idle_stats_frame = ppu->frame_count;
+        idle_cycles_last_frame = idle_cycles_this_frame;
+        idle_cycles_this_frame = 0;
+    }
+
+    if (!cpu.loop_iteration_ended()) {
+        return;
+    }
+
+    // A loop polling PPUSTATUS is only idle if the PPU left it alone for a whole iteration
+    const auto status_changes = ppu->StatusChanges();
+    const bool status_changed = status_changes != idle_status_changes;
+    idle_status_changes = status_changes;
+
+    const auto now = bus->cycles;
+    const auto period = cpu.idle_loop_cycles();
+    const bool irq_enabled = !cpu.flag_set(StatusFlag::InterruptDisable);
+    if (period == 0 || (status_changed && cpu.idle_loop_polls_ppu_status()) || now >= target_cycles
+        || interrupts.nmi_pending || (irq_enabled && interrupts.IrqAsserted())) {
+        return;
+    }
+
+    // The loop keeps spinning until the PPU or APU changes something it can see
+    auto deadline = std::min(
+        target_cycles, now + ppu->DotsUntilNextStatusEvent(cpu.idle_loop_polls_ppu_status()) / 3
+    );
+    if (irq_enabled) {
+        if (const auto frame_irq = apu->CyclesUntilFrameIrq(now); frame_irq) {
+            deadline = std::min(deadline, now + *frame_irq);
+        }
+        if (const auto mapper_irq = ppu->DotsUntilMapperIrq(); mapper_irq) {
+            deadline = std::min(deadline, now + *mapper_irq / 3);
+        }
+    }
+
+    // Leave the last iteration to the CPU so it observes the event itself
+    const auto iterations = (deadline - now) / period;
+    if (iterations <= 1) {
+        return;
+    }
+
+    const auto idle_cycles = (iterations - 1) * period;
+    bus->idle(idle_cycles);
+    idle_cycles_this_frame += idle_cycles;
 }
 
 void Sen::set_pressed_keys(const ControllerPort port, const byte key) const {
     controller->set_pressed_keys(port, key);
 }
 
-std::shared_ptr<Cartridge> ParseRomFile(const RomArgs& rom_args) {
+void Sen::ObserveLuma(const std::span<byte> luma, const size_t width, const size_t height) const {
+    DownsampleLuma(ppu->Framebuffer(), luma, width, height);
+}
+
+void Sen::ObserveRam(const std::span<byte, IWRAM_SIZE> ram) const {
+    std::ranges::copy(bus->ram(), ram.begin());
+}
+
+void Sen::ObserveNametable(const std::span<byte, NAMETABLE_TILES> tiles) const {
+    ppu->CopyBaseNametable(tiles);
+}
+
+MemoryFootprint Sen::Footprint() const {
+    return {
+        .shared = cartridge->rom_image()->footprint(),
+        .instance = sizeof(Sen) + cpu.memory_footprint() + sizeof(Bus) + bus->ram().size()
+            + ppu->MemoryFootprint() + sizeof(Apu) + sizeof(Controller)
+            + cartridge->private_footprint() + (event_log ? event_log->MemoryFootprint() : 0),
+    };
+}
+
+std::shared_ptr<const RomImage> LoadRomImage(const RomArgs& rom_args) {
     auto rom_iter = rom_args.rom.cbegin();
 
     if (*(rom_iter + 0) != '\x4E' || *(rom_iter + 1) != '\x45' || *(rom_iter + 2) != '\x53'
@@ -127,6 +286,7 @@ std::shared_ptr<Cartridge> ParseRomFile(const RomArgs& rom_args) {
     }
 
     word mapper_number;
+    byte submapper = 0;
 
     const auto flag_7 = *rom_iter++;
     const bool nes2_0_format = (flag_7 & 0x0C) == 0x08;
@@ -139,7 +299,7 @@ std::shared_ptr<Cartridge> ParseRomFile(const RomArgs& rom_args) {
         const auto flag_8 = *rom_iter++;
         mapper_number = ((flag_8 & 0x0F) << 8) | (flag_7 & 0xF0) | ((flag_6 & 0xF0) >> 4);
 
-        const auto submapper = (flag_8 & 0xF0) >> 4;
+        submapper = (flag_8 & 0xF0) >> 4;
         spdlog::info("ROM has sub mapper: {}", submapper);
 
         const auto flag_9 = *rom_iter++;
@@ -178,6 +338,7 @@ std::shared_ptr<Cartridge> ParseRomFile(const RomArgs& rom_args) {
         .prg_ram_size = prg_ram_size,
         .hardware_mirroring = mirroring,
         .mapper_number = mapper_number,
+        .submapper = submapper,
         .battery_backed_ram = battery_backed_ram
     };
 
@@ -186,17 +347,14 @@ std::shared_ptr<Cartridge> ParseRomFile(const RomArgs& rom_args) {
         std::advance(rom_iter, 512);
     }
 
-    // Read PRG-ROM
-    std::vector<byte> prg_rom;
-    prg_rom.reserve(prg_rom_size);
-    std::copy_n(rom_iter, prg_rom_size, std::back_inserter(prg_rom));
+    // Instances of the same ROM share one copy of it
+    const std::span<const byte> prg_rom{rom_iter, prg_rom_size};
     std::advance(rom_iter, prg_rom_size);
+    const std::span<const byte> chr_rom{rom_iter, chr_rom_size};
 
-    // Read CHR-ROM
-    std::vector<byte> chr_rom;
-    chr_rom.reserve(chr_rom_size);
-    std::copy_n(rom_iter, chr_rom_size, std::back_inserter(chr_rom));
-    std::advance(rom_iter, chr_rom_size);
+    return RomImageCache::global().get(header, prg_rom, chr_rom);
+}
 
-    return init_mapper(header, std::move(prg_rom), std::move(chr_rom));
+std::shared_ptr<Cartridge> ParseRomFile(const RomArgs& rom_args) {
+    return init_mapper(LoadRomImage(rom_args));
 }
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "batch_cpu.hxx"
+#include "constants.hxx"
+#include "controller.hxx"
+#include "debugger.hxx"
+#include "ppu.hxx"
+#include "sen.hxx"
+
+class NullAudioQueue final : public AudioQueue {
+  public:
+    void push(float) override {}
+};
+
+// NROM image with a single 16KB PRG bank at $C000. The main loop keeps zero page busy while the
+// NMI handler reads the controller, takes an extra branch if A is held and writes the backdrop
+// color, so lanes pressing A drift apart from the others
+static RomArgs make_rom() {
+    const std::vector<byte> main{
+        0xA9, 0x80, // C000: LDA #$80
+        0x8D, 0x00, 0x20, // C002: STA $2000
+        0xE8, // C005: INX
+        0x86, 0x12, // C006: STX $12
+        0xA5, 0x12, // C008: LDA $12
+        0x18, // C00A: CLC
+        0x65, 0x11, // C00B: ADC $11
+        0x85, 0x13, // C00D: STA $13
+        0x4C, 0x05, 0xC0, // C00F: JMP $C005
+    };
+    const std::vector<byte> nmi{
+        0xA9, 0x01, // C020: LDA #$01
+        0x8D, 0x16, 0x40, // C022: STA $4016
+        0xA9, 0x00, // C025: LDA #$00
+        0x8D, 0x16, 0x40, // C027: STA $4016
+        0xAD, 0x16, 0x40, // C02A: LDA $4016
+        0x29, 0x01, // C02D: AND #$01
+        0xF0, 0x02, // C02F: BEQ $C033
+        0xE6, 0x14, // C031: INC $14
+        0x18, // C033: CLC
+        0x65, 0x11, // C034: ADC $11
+        0x69, 0x01, // C036: ADC #$01
+        0x85, 0x11, // C038: STA $11
+        0xA0, 0x3F, // C03A: LDY #$3F
+        0x8C, 0x06, 0x20, // C03C: STY $2006
+        0xA0, 0x00, // C03F: LDY #$00
+        0x8C, 0x06, 0x20, // C041: STY $2006
+        0x29, 0x3F, // C044: AND #$3F
+        0x8D, 0x07, 0x20, // C046: STA $2007
+        0x40, // C049: RTI
+    };
+
+    std::vector<byte> rom{'N', 'E', 'S', 0x1A, 1, 1, 0, 0};
+    rom.resize(16, 0x00);
+
+    std::vector<byte> prg(0x4000, 0xEA); // NOP
+    std::ranges::copy(main, prg.begin());
+    std::ranges::copy(nmi, prg.begin() + 0x20);
+    prg[0x3FFA] = 0x20; // NMI vector, $C020
+    prg[0x3FFB] = 0xC0;
+    prg[0x3FFC] = 0x00; // Reset vector, $C000
+    prg[0x3FFD] = 0xC0;
+    rom.insert(rom.end(), prg.begin(), prg.end());
+    rom.resize(rom.size() + 0x2000, 0x00); // CHR-ROM
+
+    return RomArgs{rom};
+}
+
+TEST_CASE("Every lane runs the same as a Sen of its own", "[batchCpu]") {
+    constexpr size_t LANES = 6;
+    const bool lockstep = GENERATE(true, false);
+
+    const auto rom = make_rom();
+    BatchCpu batch{rom, LANES};
+    batch.set_lockstep(lockstep);
+
+    std::vector<std::shared_ptr<Sen>> instances;
+    for (size_t lane = 0; lane < LANES; lane++) {
+        instances.push_back(std::make_shared<Sen>(rom, std::make_shared<NullAudioQueue>()));
+
+        // Half of the lanes hold A and fall out of step with the rest
+        const byte keys = lane % 2 == 0 ? static_cast<byte>(ControllerKey::A) : 0x00;
+        batch.set_pressed_keys(lane, ControllerPort::Port1, keys);
+        instances.back()->set_pressed_keys(ControllerPort::Port1, keys);
+    }
+
+    std::array<byte, IWRAM_SIZE> lane_ram{};
+    std::array<byte, IWRAM_SIZE> sen_ram{};
+    for (unsigned int frame = 0; frame < 5; frame++) {
+        batch.run_for_one_frame();
+
+        for (size_t lane = 0; lane < LANES; lane++) {
+            auto& sen = *instances[lane];
+            sen.RunForOneFrame();
+            const Debugger debugger{instances[lane]};
+
+            const auto lane_state = Debugger::GetCpuState(batch, lane);
+            const auto sen_state = debugger.GetCpuState();
+            REQUIRE(lane_state.pc == sen_state.pc);
+            REQUIRE(lane_state.a == sen_state.a);
+            REQUIRE(lane_state.x == sen_state.x);
+            REQUIRE(lane_state.y == sen_state.y);
+            REQUIRE(lane_state.s == sen_state.s);
+            REQUIRE(lane_state.p == sen_state.p);
+
+            batch.observe_ram(lane, lane_ram);
+            sen.ObserveRam(sen_ram);
+            REQUIRE(lane_ram == sen_ram);
+
+            const auto& lane_frame = Debugger::Framebuffer(batch, lane);
+            const auto& sen_frame = debugger.Framebuffer();
+            REQUIRE(lane_frame.pixels == sen_frame.pixels);
+            REQUIRE(lane_frame.emphasis == sen_frame.emphasis);
+        }
+    }
+
+    if (lockstep) {
+        REQUIRE(batch.lockstep_instruction_count() > 0);
+    }
+}
@@ -1,11 +1,16 @@
 #include <fmt/core.h>
 #include <spdlog/cfg/env.h>
 
+#include <algorithm>
+#include <array>
 #include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <nlohmann/json_fwd.hpp>
+#include <span>
 #include <vector>
 
 #include "sen.hxx"
@@ -13,8 +18,10 @@
 #define CPU_TEST
 
 #include "constants.hxx"
+#include "coroutine_cpu.hxx"
 #include "debugger.hxx"
 #include "flatbus.hxx"
+#include "interrupts.hxx"
 
 static void load_instruction_cycles(const nlohmann::json& cycle_data, std::vector<Cycle>& cycles) {
     for (auto cycle : cycle_data) {
@@ -27,9 +34,9 @@ static nlohmann::json load_test_cases_json(byte opcode) {
     return nlohmann::json::parse(tests_json_file);
 }
 
+template<typename CpuType>
 static void test_opcode(const nlohmann::json& tests_data) {
-    auto nmi_requested = std::make_shared<bool>(false);
-    auto irq_requested = std::make_shared<bool>(false);
+    InterruptLines interrupts{};
     std::vector<Cycle> expected_cycles{};
     // Most opcodes require at most 7 cycles
     expected_cycles.reserve(7);
@@ -41,7 +48,7 @@ static void test_opcode(const nlohmann::json& tests_data) {
 
         auto bus = std::make_shared<FlatBus>(expected_cycles);
         REQUIRE(bus->cycles == 0); // Tests require cycles to start at zero
-        Cpu<FlatBus> cpu{bus, nmi_requested, irq_requested};
+        CpuType cpu{bus, &interrupts};
         auto cpu_state = Debugger::GetCpuState(cpu);
 
         auto initial_state = test_case["initial"];
@@ -77,7 +84,9 @@ static void test_opcode(const nlohmann::json& tests_data) {
 #define OPCODE_TEST(opc) \
     TEST_CASE("Test opcode " #opc, "[opcodeTest" #opc "]") { \
         spdlog::cfg::load_env_levels(); \
-        test_opcode(load_test_cases_json(opc)); \
+        const auto tests_data = load_test_cases_json(opc); \
+        test_opcode<Cpu<FlatBus>>(tests_data); \
+        test_opcode<CoroutineCpu<FlatBus>>(tests_data); \
     }
 
 // Only testing for the legal opcodes and JAMs
@@ -250,3 +259,183 @@ OPCODE_TEST(0xF8)
 OPCODE_TEST(0xF9)
 OPCODE_TEST(0xFD)
 OPCODE_TEST(0xFE)
+
+// Two 32KB PRG banks switched by writing the bank number anywhere in 0x8000-0xFFFF
+class BankedBus {
+  private:
+    std::array<std::array<byte, 0x8000>, 2> prg_banks{};
+    std::array<byte, 0x800> ram{};
+    size_t prg_bank{};
+    std::array<const byte*, 8> windows{};
+
+    void map_windows() {
+        for (size_t window = 0; window < windows.size(); window++) {
+            windows[window] = prg_banks[prg_bank].data() + window * PRG_WINDOW_SIZE;
+        }
+    }
+
+  public:
+    unsigned int cycles{};
+
+    explicit BankedBus(const std::array<std::array<byte, 0x8000>, 2>& prg_banks) :
+        prg_banks{prg_banks} {
+        map_windows();
+    }
+
+    [[nodiscard]] std::span<const byte* const, 8> prg_windows() const {
+        return windows;
+    }
+
+    void tick() {
+        cycles++;
+    }
+
+    [[nodiscard]] byte cpu_read(const word address) const {
+        if (address >= 0x8000) {
+            return prg_banks[prg_bank][address - 0x8000];
+        }
+        return ram[address % 0x800];
+    }
+
+    void cpu_write(const word address, const byte data) {
+        if (address >= 0x8000) {
+            prg_bank = data & 0b1;
+            map_windows();
+            return;
+        }
+        ram[address % 0x800] = data;
+    }
+
+    byte ticked_cpu_read(const word address) {
+        tick();
+        return cpu_read(address);
+    }
+
+    void ticked_cpu_write(const word address, const byte data) {
+        tick();
+        cpu_write(address, data);
+    }
+};
+
+template<typename CpuType>
+static void test_code_fetch_after_bank_switch() {
+    // 0x8000: LDX #$11 (#$22 in bank 1)
+    // 0x8002: LDA #$01
+    // 0x8004: STA $8000
+    // 0x8007: JMP $8000
+    constexpr std::array<byte, 10> code{0xA2, 0x11, 0xA9, 0x01, 0x8D, 0x00, 0x80, 0x4C, 0x00, 0x80};
+    std::array<std::array<byte, 0x8000>, 2> prg_banks{};
+    for (auto& prg_bank : prg_banks) {
+        std::copy(code.begin(), code.end(), prg_bank.begin());
+    }
+    prg_banks[1][1] = 0x22;
+
+    auto bus = std::make_shared<BankedBus>(prg_banks);
+    InterruptLines interrupts{};
+    CpuType cpu{bus, &interrupts};
+    auto cpu_state = Debugger::GetCpuState(cpu);
+    cpu_state.pc = 0x8000;
+
+    cpu.step();
+    REQUIRE(cpu_state.x == 0x11);
+
+    cpu.step(); // LDA
+    cpu.step(); // STA, switches to bank 1
+    cpu.step(); // JMP
+    REQUIRE(cpu_state.pc == 0x8000);
+
+    cpu.step();
+    REQUIRE(cpu_state.x == 0x22);
+    REQUIRE(bus->cycles == 2 + 2 + 4 + 3 + 2);
+}
+
+TEST_CASE("Code is fetched through the PRG windows after a bank switch", "[codeFetch]") {
+    test_code_fetch_after_bank_switch<Cpu<BankedBus>>();
+    test_code_fetch_after_bank_switch<CoroutineCpu<BankedBus>>();
+}
+
+template<typename CpuType>
+static void test_idle_loop_and_jam() {
+    // 0x8000: LDA $02
+    // 0x8002: BEQ $8000
+    // 0x8004: JAM
+    std::array<std::array<byte, 0x8000>, 2> prg_banks{};
+    constexpr std::array<byte, 5> code{0xA5, 0x02, 0xF0, 0xFC, 0x02};
+    std::copy(code.begin(), code.end(), prg_banks[0].begin());
+
+    auto bus = std::make_shared<BankedBus>(prg_banks);
+    InterruptLines interrupts{};
+    CpuType cpu{bus, &interrupts};
+    cpu.set_idle_loop_detection(true);
+    auto cpu_state = Debugger::GetCpuState(cpu);
+    cpu_state.pc = 0x8000;
+
+    // The first iteration only records where the loop starts
+    for (int i = 0; i < 4; i++) {
+        cpu.step();
+    }
+    REQUIRE(cpu.loop_iteration_ended());
+    REQUIRE(cpu.idle_loop_cycles() == 3 + 3);
+    REQUIRE_FALSE(cpu.idle_loop_polls_ppu_status());
+
+    bus->cpu_write(0x0002, 0x01);
+    cpu.step(); // LDA
+    cpu.step(); // BEQ, not taken
+    REQUIRE(cpu.idle_loop_cycles() == 0);
+    REQUIRE_FALSE(cpu.jammed());
+
+    cpu.step();
+    REQUIRE(cpu.jammed());
+    REQUIRE(cpu.program_counter() == 0x8004);
+}
+
+// `CoroutineCpu` is benchmarked against `Cpu`, so it has to run the same machine
+TEST_CASE("Both CPUs detect idle loops and jams the same way", "[idleLoop]") {
+    test_idle_loop_and_jam<Cpu<BankedBus>>();
+    test_idle_loop_and_jam<CoroutineCpu<BankedBus>>();
+}
+
+TEST_CASE("An IRQ stays asserted while any of its sources holds it", "[interrupts]") {
+    InterruptLines interrupts{};
+
+    interrupts.AssertIrq(IrqSource::FrameCounter, 10);
+    interrupts.AssertIrq(IrqSource::Dmc, 20);
+    REQUIRE(interrupts.irq_cycle == 10);
+
+    interrupts.ReleaseIrq(IrqSource::FrameCounter);
+    REQUIRE(interrupts.IrqAsserted());
+    REQUIRE(interrupts.IrqAsserted(IrqSource::Dmc));
+    REQUIRE_FALSE(interrupts.IrqAsserted(IrqSource::FrameCounter));
+
+    interrupts.ReleaseIrq(IrqSource::Dmc);
+    REQUIRE_FALSE(interrupts.IrqAsserted());
+}
+
+TEST_CASE("An NMI raised on the last cycle of an instruction waits for the next one", "[interrupts]") {
+    // 0x8000: NOP
+    // 0x8001: NOP
+    // 0x9000: NMI handler, NOP
+    std::array<std::array<byte, 0x8000>, 2> prg_banks{};
+    prg_banks[0][0x0000] = 0xEA;
+    prg_banks[0][0x0001] = 0xEA;
+    prg_banks[0][0x1000] = 0xEA;
+    prg_banks[0][0x7FFA] = 0x00;
+    prg_banks[0][0x7FFB] = 0x90;
+
+    auto bus = std::make_shared<BankedBus>(prg_banks);
+    InterruptLines interrupts{};
+    Cpu<BankedBus> cpu{bus, &interrupts};
+    auto cpu_state = Debugger::GetCpuState(cpu);
+    cpu_state.pc = 0x8000;
+
+    cpu.step();
+    interrupts.RaiseNmi(bus->cycles);
+
+    cpu.step();
+    REQUIRE(cpu_state.pc == 0x8002);
+    REQUIRE(interrupts.nmi_pending);
+
+    cpu.step(); // Services the NMI before fetching the next opcode
+    REQUIRE_FALSE(interrupts.nmi_pending);
+    REQUIRE(cpu_state.pc == 0x9001);
+}
@@ -0,0 +1,230 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cartridge.hxx"
+#include "constants.hxx"
+#include "declarative_mapper.hxx"
+#include "interrupts.hxx"
+#include "mapper.hxx"
+#include "rom_image.hxx"
+
+// ROM whose banks of `bank_size` each start with their number, the rest filled with 0xFF so that
+// bus conflicts elsewhere leave writes alone
+static std::vector<byte> numbered_banks(const size_t size, const size_t bank_size) {
+    std::vector<byte> rom(size, 0xFF);
+    for (size_t bank = 0; bank < size / bank_size; bank++) {
+        rom[bank * bank_size] = static_cast<byte>(bank);
+    }
+    return rom;
+}
+
+// Image of a ROM for `mapper`, with CHR-RAM if `chr_rom` is empty
+static std::shared_ptr<const RomImage>
+make_image(const word mapper, std::vector<byte>&& prg_rom, std::vector<byte>&& chr_rom) {
+    const RomHeader header{
+        .prg_rom_size = prg_rom.size(),
+        .prg_rom_banks = prg_rom.size() / 0x4000,
+        .chr_rom_size = chr_rom.size(),
+        .chr_rom_banks = chr_rom.size() / 0x2000,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Vertical,
+        .mapper_number = mapper,
+    };
+    return std::make_shared<const RomImage>(header, std::move(prg_rom), std::move(chr_rom));
+}
+
+TEST_CASE("UxROM switches $8000 and keeps the last bank at $C000", "[mapper][uxrom]") {
+    Uxrom cartridge{make_image(2, numbered_banks(0x20000, 0x4000), {})};
+
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 0);
+    REQUIRE(cartridge.cpu_read(0, 0xC000) == 7);
+
+    cartridge.cpu_write(0, 0x8001, 5);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 5);
+    REQUIRE(cartridge.cpu_read(0, 0xC000) == 7);
+    REQUIRE(cartridge.mirroring() == Mirroring::Vertical);
+
+    // Bus conflict with the bank number at $C000
+    cartridge.cpu_write(0, 0xC000, 3);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 3);
+    cartridge.cpu_write(0, 0xC000, 0x0F);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 7);
+
+    // CHR-RAM
+    cartridge.ppu_write(0x1234, 0xAB);
+    REQUIRE(cartridge.ppu_read(0x1234) == 0xAB);
+}
+
+TEST_CASE("CNROM switches 8KB of CHR-ROM", "[mapper][cnrom]") {
+    Cnrom cartridge{make_image(3, numbered_banks(0x8000, 0x4000), numbered_banks(0x8000, 0x2000))};
+
+    REQUIRE(cartridge.ppu_read(0x0000) == 0);
+    cartridge.cpu_write(0, 0x8001, 2);
+    REQUIRE(cartridge.ppu_read(0x0000) == 2);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 0);
+    REQUIRE(cartridge.cpu_read(0, 0xC000) == 1);
+
+    // Bank bits beyond the mask are not connected
+    cartridge.cpu_write(0, 0x8001, 0x07);
+    REQUIRE(cartridge.ppu_read(0x0000) == 3);
+}
+
+TEST_CASE("AxROM switches 32KB and picks a single nametable", "[mapper][axrom]") {
+    Axrom cartridge{make_image(7, numbered_banks(0x20000, 0x8000), {})};
+
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 0);
+    REQUIRE(cartridge.mirroring() == Mirroring::SingleScreenLower);
+
+    const auto generation = cartridge.nametable_generation();
+    cartridge.cpu_write(0, 0x8000, 0x13);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 3);
+    REQUIRE(cartridge.mirroring() == Mirroring::SingleScreenUpper);
+    REQUIRE(cartridge.nametable_generation() != generation);
+
+    // Only a change of nametable bumps the generation
+    const auto upper_generation = cartridge.nametable_generation();
+    cartridge.cpu_write(0, 0x8000, 0x12);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 2);
+    REQUIRE(cartridge.nametable_generation() == upper_generation);
+}
+
+TEST_CASE("Color Dreams takes PRG from the low bits and CHR from the high", "[mapper]") {
+    ColorDreams cartridge{
+        make_image(11, numbered_banks(0x20000, 0x8000), numbered_banks(0x20000, 0x2000))
+    };
+
+    cartridge.cpu_write(0, 0x8001, 0xA2);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 2);
+    REQUIRE(cartridge.ppu_read(0x0000) == 10);
+}
+
+TEST_CASE("GxROM takes PRG from the high bits and CHR from the low", "[mapper][gxrom]") {
+    Gxrom cartridge{
+        make_image(66, numbered_banks(0x20000, 0x8000), numbered_banks(0x8000, 0x2000))
+    };
+
+    cartridge.cpu_write(0, 0x8001, 0x21);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 2);
+    REQUIRE(cartridge.ppu_read(0x0000) == 1);
+    // What the CPU fetches code through
+    REQUIRE(cartridge.mapped_prg_windows()[0][0] == 2);
+}
+
+TEST_CASE("Camerica only latches writes to $C000-$FFFF", "[mapper][camerica]") {
+    Camerica cartridge{make_image(71, numbered_banks(0x20000, 0x4000), {})};
+
+    cartridge.cpu_write(0, 0x9000, 0x10);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 0);
+    REQUIRE(cartridge.mirroring() == Mirroring::Vertical);
+
+    // No bus conflicts, bank 7 starts at $C000
+    cartridge.cpu_write(0, 0xC000, 4);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 4);
+    REQUIRE(cartridge.cpu_read(0, 0xC000) == 7);
+}
+
+TEST_CASE("Fire Hawk also picks a single nametable at $9000-$9FFF", "[mapper][camerica]") {
+    FireHawk cartridge{make_image(71, numbered_banks(0x20000, 0x4000), {})};
+    REQUIRE(cartridge.mirroring() == Mirroring::SingleScreenLower);
+
+    cartridge.cpu_write(0, 0x9000, 0x10);
+    REQUIRE(cartridge.mirroring() == Mirroring::SingleScreenUpper);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 0);
+
+    cartridge.cpu_write(0, 0xC000, 4);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 4);
+    REQUIRE(cartridge.mirroring() == Mirroring::SingleScreenUpper);
+}
+
+TEST_CASE("MMC3 maps its bank registers and counts A12 rises", "[mapper][mmc3]") {
+    Mmc3 cartridge{make_image(4, numbered_banks(0x20000, 0x2000), numbered_banks(0x10000, 0x400))};
+    InterruptLines interrupts{};
+    cartridge.connect_interrupts(&interrupts);
+
+    // The last two 8KB banks are fixed at $C000 and $E000, or $8000 and $E000 in PRG mode 1
+    cartridge.cpu_write(0, 0x8000, 6);
+    cartridge.cpu_write(0, 0x8001, 3);
+    cartridge.cpu_write(0, 0x8000, 7);
+    cartridge.cpu_write(0, 0x8001, 5);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 3);
+    REQUIRE(cartridge.cpu_read(0, 0xA000) == 5);
+    REQUIRE(cartridge.cpu_read(0, 0xC000) == 14);
+    REQUIRE(cartridge.cpu_read(0, 0xE000) == 15);
+    cartridge.cpu_write(0, 0x8000, 0x46);
+    REQUIRE(cartridge.cpu_read(0, 0x8000) == 14);
+    REQUIRE(cartridge.cpu_read(0, 0xC000) == 3);
+
+    // 2KB CHR banks ignore their low bit and swap places with the 1KB ones on bit 7
+    cartridge.cpu_write(0, 0x8000, 0);
+    cartridge.cpu_write(0, 0x8001, 9);
+    cartridge.cpu_write(0, 0x8000, 2);
+    cartridge.cpu_write(0, 0x8001, 20);
+    REQUIRE(cartridge.ppu_read(0x0000) == 8);
+    REQUIRE(cartridge.ppu_read(0x0400) == 9);
+    REQUIRE(cartridge.ppu_read(0x1000) == 20);
+    cartridge.cpu_write(0, 0x8000, 0x80);
+    REQUIRE(cartridge.ppu_read(0x1000) == 8);
+    REQUIRE(cartridge.ppu_read(0x0000) == 20);
+
+    cartridge.cpu_write(0, 0xA000, 1);
+    REQUIRE(cartridge.mirroring() == Mirroring::Horizontal);
+
+    // PRG-RAM is write-protected with bit 6 of $A001 and switched off with bit 7 clear
+    cartridge.cpu_write(0, 0x6000, 0x12);
+    cartridge.cpu_write(0, 0xA001, 0xC0);
+    cartridge.cpu_write(0, 0x6000, 0x34);
+    REQUIRE(cartridge.cpu_read(0, 0x6000) == 0x12);
+    cartridge.cpu_write(0, 0xA001, 0x00);
+    REQUIRE(cartridge.cpu_read(0, 0x6000) == 0x00);
+    cartridge.cpu_write(0, 0x6000, 0x34);
+    cartridge.cpu_write(0, 0xA001, 0x80);
+    REQUIRE(cartridge.cpu_read(0, 0x6000) == 0x12);
+    cartridge.cpu_write(0, 0x6000, 0x34);
+    REQUIRE(cartridge.cpu_read(0, 0x6000) == 0x34);
+
+    // Reloaded with the latch on the first rise, then asserts when it counts down to 0
+    cartridge.cpu_write(0, 0xC000, 2);
+    cartridge.cpu_write(0, 0xC001, 0);
+    cartridge.cpu_write(0, 0xE001, 0);
+    REQUIRE(cartridge.a12_rises_until_irq() == 3U);
+    cartridge.ppu_a12_rise(100);
+    cartridge.ppu_a12_rise(200);
+    REQUIRE(!interrupts.IrqAsserted());
+    cartridge.ppu_a12_rise(300);
+    REQUIRE(interrupts.IrqAsserted(IrqSource::Mapper));
+    REQUIRE(interrupts.irq_cycle == 300);
+
+    // Disabling acknowledges it
+    cartridge.cpu_write(0, 0xE000, 0);
+    REQUIRE(!interrupts.IrqAsserted());
+    REQUIRE(!cartridge.a12_rises_until_irq().has_value());
+}
+
+TEST_CASE("Cartridges map banks out of a shared image and keep their own RAM", "[mapper][rom]") {
+    const auto image = make_image(2, numbered_banks(0x20000, 0x4000), {});
+    Uxrom first{image};
+    Uxrom second{image};
+    REQUIRE(first.rom_image() == second.rom_image());
+
+    first.cpu_write(0, 0x8001, 3);
+    REQUIRE(first.cpu_read(0, 0x8000) == 3);
+    REQUIRE(second.cpu_read(0, 0x8000) == 0);
+
+    // CHR-RAM and its decoded tiles
+    first.ppu_write(0x0010, 0xFF);
+    REQUIRE(first.ppu_read(0x0010) == 0xFF);
+    REQUIRE(second.ppu_read(0x0010) == 0x00);
+    REQUIRE(first.ppu_tile_row(0x0010).pixels[0] == 1);
+    REQUIRE(second.ppu_tile_row(0x0010).pixels[0] == 0);
+    REQUIRE(first.private_footprint() >= 0x2000);
+
+    // CHR-ROM is decoded with the image and not counted against the cartridge
+    Cnrom cnrom{make_image(3, numbered_banks(0x8000, 0x4000), numbered_banks(0x8000, 0x2000))};
+    REQUIRE(cnrom.private_footprint() < 0x2000);
+    cnrom.cpu_write(0, 0x8001, 1);
+    REQUIRE(cnrom.ppu_tile_row(0x0000).pixels[7] == 3);
+}
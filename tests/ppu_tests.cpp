@@ -0,0 +1,573 @@
+#include <algorithm>
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "constants.hxx"
+#include "debugger.hxx"
+#include "interrupts.hxx"
+#include "mapper.hxx"
+#include "observations.hxx"
+#include "palette.hxx"
+#include "ppu.hxx"
+#include "rom_image.hxx"
+#include "sen.hxx"
+#include "util.hxx"
+
+class NullAudioQueue final : public AudioQueue {
+  public:
+    void push(float) override {}
+};
+
+static uint64_t framebuffer_hash(const PpuFramebuffer& framebuffer) {
+    // FNV-1a
+    uint64_t hash = 0xCBF29CE484222325;
+    for (const auto color : framebuffer.pixels) {
+        hash ^= color;
+        hash *= 0x100000001B3;
+    }
+    for (const auto emphasis : framebuffer.emphasis) {
+        hash ^= emphasis;
+        hash *= 0x100000001B3;
+    }
+    return hash;
+}
+
+TEST_CASE("Scanline and dot renderers produce the same frames", "[ppu][scanlineRenderer]") {
+    // NROM and MMC1 ROMs exercising scrolling, sprite 0 hits and mid-frame register writes
+    const std::string rom_path = GENERATE(
+        "sprite_hit_tests_2005.10.05/01.basics.nes",
+        "sprite_hit_tests_2005.10.05/02.alignment.nes",
+        "sprite_hit_tests_2005.10.05/05.left_clip.nes",
+        "sprite_hit_tests_2005.10.05/09.timing_basics.nes",
+        "sprite_hit_tests_2005.10.05/10.timing_order.nes",
+        "sprite_hit_tests_2005.10.05/11.edge_timing.nes",
+        "sprite_overflow_tests/1.Basics.nes",
+        "blargg_ppu_tests_2005.09.15b/vram_access.nes",
+        "scrolltest/scroll.nes",
+        "full_palette/full_palette.nes",
+        "nmi_sync/demo_ntsc.nes",
+        "spritecans-2011/spritecans.nes",
+        "instr_test-v5/official_only.nes"
+    );
+    const auto path = std::filesystem::path{"./nes-test-roms"} / rom_path;
+    if (!std::filesystem::exists(path)) {
+        SKIP("Missing test ROM " << path.string());
+    }
+
+    const RomArgs rom_args{ReadBinaryFile(path)};
+    auto scanline = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    auto dot = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    scanline->SetScanlineRendering(true);
+    dot->SetScanlineRendering(false);
+
+    const Debugger scanline_debugger{scanline};
+    const Debugger dot_debugger{dot};
+    for (unsigned int frame = 0; frame < 180; frame++) {
+        scanline->RunForOneFrame();
+        dot->RunForOneFrame();
+
+        INFO(rom_path << " frame " << frame);
+        REQUIRE(
+            framebuffer_hash(scanline_debugger.Framebuffer())
+            == framebuffer_hash(dot_debugger.Framebuffer())
+        );
+    }
+}
+
+TEST_CASE("Decoded CHR-RAM tiles follow writes", "[ppu][chrCache]") {
+    const RomHeader header{
+        .prg_rom_size = 0x8000,
+        .prg_rom_banks = 2,
+        .chr_rom_size = 0,
+        .chr_rom_banks = 0,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Horizontal,
+        .mapper_number = 1,
+    };
+    Mmc1 cartridge{
+        std::make_shared<const RomImage>(header, std::vector<byte>(0x8000), std::vector<byte>{})
+    };
+
+    // Row 3 of tile 0x21 in the right pattern table
+    const word address = 0x1000 + (0x21 << 4) + 3;
+    constexpr std::array<byte, 8> blank{};
+    REQUIRE(cartridge.ppu_tile_row(address).pixels == blank);
+
+    cartridge.ppu_write(address, 0b1010'0000);
+    cartridge.ppu_write(address + 8, 0b0110'0001);
+    constexpr std::array<byte, 8> pixels{1, 2, 3, 0, 0, 0, 0, 2};
+    constexpr std::array<byte, 8> flipped{2, 0, 0, 0, 0, 3, 2, 1};
+    REQUIRE(cartridge.ppu_tile_row(address).pixels == pixels);
+    REQUIRE(cartridge.ppu_tile_row(address).flipped == flipped);
+
+    // The rest of the bank is decoded again too
+    REQUIRE(cartridge.ppu_tile_row(address + 1).pixels == blank);
+}
+
+TEST_CASE("MMC1 bank switches remap the PRG and CHR windows", "[mapper][mmc1]") {
+    const RomHeader header{
+        .prg_rom_size = 0x20000,
+        .prg_rom_banks = 8,
+        .chr_rom_size = 0x8000,
+        .chr_rom_banks = 4,
+        .prg_ram_size = 0x2000,
+        .hardware_mirroring = Mirroring::Horizontal,
+        .mapper_number = 1,
+    };
+
+    // Every 16KB PRG bank and 4KB CHR bank starts with its number
+    std::vector<byte> prg_rom(header.prg_rom_size);
+    for (size_t bank = 0; bank < 8; bank++) {
+        prg_rom[bank * 0x4000] = bank;
+    }
+    std::vector<byte> chr_rom(header.chr_rom_size);
+    for (size_t bank = 0; bank < 8; bank++) {
+        chr_rom[bank * 0x1000] = bank;
+    }
+    Mmc1 cartridge{
+        std::make_shared<const RomImage>(header, std::move(prg_rom), std::move(chr_rom))
+    };
+
+    // Registers are loaded a bit at a time, on writes at least two cycles apart
+    uint64_t cycle = 10;
+    const auto write_register = [&](const word address, const byte value) {
+        for (unsigned int bit = 0; bit < 5; bit++) {
+            cartridge.cpu_write(cycle, address, (value >> bit) & 0b1);
+            cycle += 2;
+        }
+    };
+
+    // Fixed last bank at $C000 after power up
+    REQUIRE(cartridge.cpu_read(cycle, 0x8000) == 0);
+    REQUIRE(cartridge.cpu_read(cycle, 0xC000) == 7);
+    write_register(0xE000, 3);
+    REQUIRE(cartridge.cpu_read(cycle, 0x8000) == 3);
+    REQUIRE(cartridge.cpu_read(cycle, 0xC000) == 7);
+
+    // 32KB PRG and 4KB CHR banks
+    write_register(0x8000, 0b10000);
+    REQUIRE(cartridge.cpu_read(cycle, 0x8000) == 2);
+    REQUIRE(cartridge.cpu_read(cycle, 0xC000) == 3);
+    write_register(0xA000, 5);
+    write_register(0xC000, 2);
+    REQUIRE(cartridge.ppu_read(0x0000) == 5);
+    REQUIRE(cartridge.ppu_read(0x1000) == 2);
+
+    // 8KB CHR banks ignore the low bit
+    write_register(0x8000, 0b00000);
+    REQUIRE(cartridge.ppu_read(0x0000) == 4);
+    REQUIRE(cartridge.ppu_read(0x1000) == 5);
+
+    cartridge.cpu_write(cycle, 0x6123, 0x42);
+    REQUIRE(cartridge.cpu_read(cycle, 0x6123) == 0x42);
+}
+
+TEST_CASE("Nametables follow the cartridge mirroring", "[ppu][nametables]") {
+    RomHeader header{
+        .prg_rom_size = 0x4000,
+        .prg_rom_banks = 1,
+        .chr_rom_size = 0x2000,
+        .chr_rom_banks = 1,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Horizontal,
+        .mapper_number = 0,
+    };
+    InterruptLines interrupts{};
+
+    const auto write_nametables = [](Ppu& ppu) {
+        for (word nametable = 0; nametable < 4; nametable++) {
+            ppu.PpuWrite(0x2000 + nametable * 0x400 + 0x123, nametable + 1);
+        }
+    };
+    const auto read_nametables = [](Ppu& ppu) {
+        std::array<byte, 4> data{};
+        for (word nametable = 0; nametable < 4; nametable++) {
+            // Through the $3000-$3EFF mirror
+            data[nametable] = ppu.PpuRead(0x3000 + nametable * 0x400 + 0x123);
+        }
+        return data;
+    };
+
+    for (const auto& [mirroring, expected] : std::array{
+             std::pair{Mirroring::Horizontal, std::array<byte, 4>{2, 2, 4, 4}},
+             std::pair{Mirroring::Vertical, std::array<byte, 4>{3, 4, 3, 4}},
+             std::pair{Mirroring::FourScreenVram, std::array<byte, 4>{1, 2, 3, 4}},
+         }) {
+        header.hardware_mirroring = mirroring;
+        Ppu ppu{
+            std::make_shared<Nrom>(std::make_shared<const RomImage>(
+                header,
+                std::vector<byte>(0x4000),
+                std::vector<byte>(0x2000)
+            )),
+            &interrupts
+        };
+        write_nametables(ppu);
+        REQUIRE(read_nametables(ppu) == expected);
+    }
+}
+
+TEST_CASE("MMC3 IRQs follow the A12 rises of the fetch schedule", "[ppu][mapper][mmc3]") {
+    // Only the sprites or only the background use the $1000 pattern table. The background also
+    // rises when fetches start again on the pre-render line, so its IRQ comes a line earlier
+    const auto [ppuctrl, irq_line, rise_dot] =
+        GENERATE(std::tuple{0x08, 4U, 261U}, std::tuple{0x10, 3U, 325U});
+
+    const RomHeader header{
+        .prg_rom_size = 0x8000,
+        .prg_rom_banks = 2,
+        .chr_rom_size = 0x2000,
+        .chr_rom_banks = 1,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Vertical,
+        .mapper_number = 4,
+    };
+    const auto cartridge = std::make_shared<Mmc3>(std::make_shared<const RomImage>(
+        header,
+        std::vector<byte>(0x8000),
+        std::vector<byte>(0x2000)
+    ));
+    InterruptLines interrupts{};
+    Ppu ppu{cartridge, &interrupts};
+    ppu.CpuWrite(0x2000, ppuctrl);
+    ppu.CpuWrite(0x2001, 0x18);
+
+    // Reloaded on the pre-render line, then counted down to 0
+    cartridge->cpu_write(0, 0xC000, 5);
+    cartridge->cpu_write(0, 0xC001, 0);
+    cartridge->cpu_write(0, 0xE001, 0);
+    const auto predicted = ppu.DotsUntilMapperIrq();
+    REQUIRE(predicted.has_value());
+
+    unsigned int dots = 0;
+    while (!interrupts.IrqAsserted(IrqSource::Mapper)) {
+        ppu.Tick(dots++ / 3);
+    }
+    REQUIRE(ppu.Scanline() == irq_line);
+    REQUIRE(ppu.LineCycles() == rise_dot);
+    REQUIRE(*predicted == dots);
+
+    // Acknowledged by disabling it
+    cartridge->cpu_write(0, 0xE000, 0);
+    REQUIRE(!interrupts.IrqAsserted());
+    REQUIRE(!ppu.DotsUntilMapperIrq().has_value());
+}
+
+TEST_CASE("Frames run without output behave the same", "[ppu][noOutput]") {
+    const std::string rom_path = GENERATE(
+        "sprite_hit_tests_2005.10.05/01.basics.nes",
+        "sprite_hit_tests_2005.10.05/09.timing_basics.nes",
+        "scrolltest/scroll.nes",
+        "instr_test-v5/official_only.nes"
+    );
+    const auto path = std::filesystem::path{"./nes-test-roms"} / rom_path;
+    if (!std::filesystem::exists(path)) {
+        SKIP("Missing test ROM " << path.string());
+    }
+
+    const RomArgs rom_args{ReadBinaryFile(path)};
+    auto rendered = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    auto skipped = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    Debugger rendered_debugger{rendered};
+    Debugger skipped_debugger{skipped};
+
+    // Sprite 0 hits and everything else the game polls must not depend on the output
+    for (unsigned int frame = 0; frame < 120; frame++) {
+        rendered->RunForOneFrame();
+        skipped->RunForOneFrame(false);
+
+        INFO(rom_path << " frame " << frame);
+        const auto rendered_state = rendered_debugger.GetCpuState();
+        const auto skipped_state = skipped_debugger.GetCpuState();
+        REQUIRE(rendered_state.pc == skipped_state.pc);
+        REQUIRE(rendered_state.a == skipped_state.a);
+        REQUIRE(rendered_state.x == skipped_state.x);
+        REQUIRE(rendered_state.y == skipped_state.y);
+        REQUIRE(rendered_state.p == skipped_state.p);
+    }
+
+    // Once output is back a whole frame later the pictures agree again
+    for (unsigned int frame = 0; frame < 2; frame++) {
+        rendered->RunForOneFrame();
+        skipped->RunForOneFrame();
+    }
+    REQUIRE(
+        framebuffer_hash(rendered_debugger.Framebuffer())
+        == framebuffer_hash(skipped_debugger.Framebuffer())
+    );
+}
+
+TEST_CASE("Predicted sprite 0 hits are seen on time by skipped idle loops", "[ppu][spriteZero]") {
+    const std::string rom_path = GENERATE(
+        "sprite_hit_tests_2005.10.05/01.basics.nes",
+        "sprite_hit_tests_2005.10.05/09.timing_basics.nes",
+        "sprite_hit_tests_2005.10.05/10.timing_order.nes",
+        "sprite_hit_tests_2005.10.05/11.edge_timing.nes"
+    );
+    const auto path = std::filesystem::path{"./nes-test-roms"} / rom_path;
+    if (!std::filesystem::exists(path)) {
+        SKIP("Missing test ROM " << path.string());
+    }
+
+    const RomArgs rom_args{ReadBinaryFile(path)};
+    auto skipping = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    auto stepped = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    skipping->SetIdleLoopSkipping(true);
+    stepped->SetScanlineRendering(false);
+    Debugger skipping_debugger{skipping};
+    Debugger stepped_debugger{stepped};
+
+    // Polling PPUSTATUS on the lines of sprite 0 neither draws them dot by dot nor stops skipping
+    for (unsigned int frame = 0; frame < 180; frame++) {
+        skipping->RunForOneFrame();
+        stepped->RunForOneFrame();
+
+        INFO(rom_path << " frame " << frame);
+        REQUIRE(skipping_debugger.GetCpuState().pc == stepped_debugger.GetCpuState().pc);
+        REQUIRE(
+            framebuffer_hash(skipping_debugger.Framebuffer())
+            == framebuffer_hash(stepped_debugger.Framebuffer())
+        );
+    }
+}
+
+TEST_CASE("Output threads draw the same frames", "[ppu][outputThreads]") {
+    const std::string rom_path = GENERATE(
+        "sprite_hit_tests_2005.10.05/01.basics.nes",
+        "sprite_hit_tests_2005.10.05/05.left_clip.nes",
+        "scrolltest/scroll.nes",
+        "full_palette/full_palette.nes",
+        "spritecans-2011/spritecans.nes"
+    );
+    const auto path = std::filesystem::path{"./nes-test-roms"} / rom_path;
+    if (!std::filesystem::exists(path)) {
+        SKIP("Missing test ROM " << path.string());
+    }
+
+    const RomArgs rom_args{ReadBinaryFile(path)};
+    const size_t threads = GENERATE(1, 3);
+    auto threaded = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    auto inline_output = std::make_shared<Sen>(rom_args, std::make_shared<NullAudioQueue>());
+    threaded->SetOutputThreads(threads);
+
+    const Debugger threaded_debugger{threaded};
+    const Debugger inline_debugger{inline_output};
+    for (unsigned int frame = 0; frame < 120; frame++) {
+        threaded->RunForOneFrame();
+        inline_output->RunForOneFrame();
+
+        INFO(rom_path << " with " << threads << " threads, frame " << frame);
+        REQUIRE(
+            framebuffer_hash(threaded_debugger.Framebuffer())
+            == framebuffer_hash(inline_debugger.Framebuffer())
+        );
+    }
+}
+
+TEST_CASE("Line kernels compose pixels like the dot renderer", "[ppu][lineKernels]") {
+    std::array<byte, 32> palette_table{};
+    for (size_t i = 0; i < palette_table.size(); i++) {
+        palette_table[i] = static_cast<byte>(i * 2 + 1);
+    }
+
+    // Every combination of background pixel and sprite pixel, several times over the line
+    std::array<byte, NES_WIDTH> background{};
+    std::array<SpritePixel, NES_WIDTH> sprites{};
+    for (size_t x = 0; x < NES_WIDTH; x++) {
+        background[x] = static_cast<byte>((x / 4) & 0x0F);
+        sprites[x] = {
+            .palette_address = static_cast<byte>(x % 4 == 0 ? 0 : 0x10 | (x % 16)),
+            .behind_background = (x & 0x02) != 0,
+            .sprite_zero = false,
+        };
+    }
+
+    const byte ppumask = GENERATE(0x18, 0x1A, 0x1C, 0x1E, 0xFF);
+    std::array<byte, NES_WIDTH> colors{};
+    Ppu::LineKernel(ppumask)(background, sprites, palette_table, colors);
+    for (size_t x = 0; x < NES_WIDTH; x++) {
+        INFO("PPUMASK " << static_cast<int>(ppumask) << " x " << x);
+        const byte palette_address = Ppu::PixelPaletteAddress(
+            ppumask,
+            static_cast<byte>(x),
+            background[x],
+            sprites[x]
+        );
+        REQUIRE(colors[x] == (palette_table[palette_address] & 0x3F));
+    }
+}
+
+TEST_CASE("Only lines that changed are dirty", "[ppu][framebuffer]") {
+    const RomHeader header{
+        .prg_rom_size = 0x4000,
+        .prg_rom_banks = 1,
+        .chr_rom_size = 0x2000,
+        .chr_rom_banks = 1,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Horizontal,
+        .mapper_number = 0,
+    };
+    InterruptLines interrupts{};
+    Ppu ppu{
+        std::make_shared<Nrom>(std::make_shared<const RomImage>(
+            header,
+            std::vector<byte>(0x4000),
+            std::vector<byte>(0x2000)
+        )),
+        &interrupts
+    };
+    const auto run_frame = [&ppu] {
+        for (unsigned int dot = 0; dot < 262 * 341; dot++) {
+            ppu.Tick(0);
+        }
+    };
+
+    // Rendering is off, so every line is the backdrop color
+    run_frame();
+    REQUIRE(ppu.Framebuffer().TakeDirtyLines().all());
+    run_frame();
+    REQUIRE(ppu.Framebuffer().TakeDirtyLines().none());
+
+    ppu.CpuWrite(0x2006, 0x3F);
+    ppu.CpuWrite(0x2006, 0x00);
+    ppu.CpuWrite(0x2007, 0x21);
+    run_frame();
+    REQUIRE(ppu.Framebuffer().TakeDirtyLines().all());
+    REQUIRE(ppu.Framebuffer().pixels.front() == 0x21);
+
+    // Emphasis alone changes a line too
+    ppu.CpuWrite(0x2001, 0x20);
+    run_frame();
+    REQUIRE(ppu.Framebuffer().TakeDirtyLines().all());
+    REQUIRE(ppu.Framebuffer().emphasis.front() == 0b001);
+    run_frame();
+    REQUIRE(ppu.Framebuffer().TakeDirtyLines().none());
+}
+
+TEST_CASE("Luma observations average the pixels they cover", "[ppu][observations]") {
+    PpuFramebuffer framebuffer{};
+    for (size_t y = 0; y < NES_HEIGHT; y++) {
+        for (size_t x = 0; x < NES_WIDTH; x++) {
+            // White top left quarter, black elsewhere
+            const byte color = x < NES_WIDTH / 2 && y < NES_HEIGHT / 2 ? 0x30 : 0x0F;
+            framebuffer.SetPixel(x, y, color, 0);
+        }
+    }
+
+    std::array<byte, 4> quarters{};
+    DownsampleLuma(framebuffer, quarters, 2, 2);
+    const std::array<byte, 4> expected_quarters{PALETTE_LUMA[0x30], 0, 0, 0};
+    REQUIRE(quarters == expected_quarters);
+
+    std::array<byte, 1> whole{};
+    DownsampleLuma(framebuffer, whole, 1, 1);
+    REQUIRE(whole[0] == (PALETTE_LUMA[0x30] + 2) / 4);
+
+    // Rows and columns that don't divide the frame evenly
+    std::array<byte, 84 * 84> agent_frame{};
+    DownsampleLuma(framebuffer, agent_frame, 84, 84);
+    REQUIRE(agent_frame.front() == PALETTE_LUMA[0x30]);
+    REQUIRE(agent_frame.back() == 0);
+}
+
+TEST_CASE("Nametable observations follow PPUCTRL", "[ppu][observations]") {
+    const RomHeader header{
+        .prg_rom_size = 0x4000,
+        .prg_rom_banks = 1,
+        .chr_rom_size = 0x2000,
+        .chr_rom_banks = 1,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Vertical,
+        .mapper_number = 0,
+    };
+    InterruptLines interrupts{};
+    Ppu ppu{
+        std::make_shared<Nrom>(std::make_shared<const RomImage>(
+            header,
+            std::vector<byte>(0x4000),
+            std::vector<byte>(0x2000)
+        )),
+        &interrupts
+    };
+
+    // Fill the right nametable with increasing tile IDs
+    ppu.CpuWrite(0x2006, 0x24);
+    ppu.CpuWrite(0x2006, 0x00);
+    for (size_t i = 0; i < NAMETABLE_TILES; i++) {
+        ppu.CpuWrite(0x2007, i & 0xFF);
+    }
+
+    std::array<byte, NAMETABLE_TILES> tiles{};
+    ppu.CopyBaseNametable(tiles);
+    REQUIRE(tiles[33] == 0);
+
+    // $2C00 mirrors $2400 with vertical mirroring
+    ppu.CpuWrite(0x2000, 0b11);
+    ppu.CopyBaseNametable(tiles);
+    REQUIRE(tiles[33] == 33);
+    REQUIRE(tiles[NAMETABLE_TILES - 1] == ((NAMETABLE_TILES - 1) & 0xFF));
+}
+
+TEST_CASE("Sprite overflow follows the diagonal OAM scan", "[ppu][spriteOverflow]") {
+    // What sprites 8 and 9 are, sprites 0 to 7 are all on line 100
+    const auto [sprite_8, sprite_9, overflows] = GENERATE(
+        std::tuple{Sprite{100, 0, 0, 0}, Sprite{0xFF, 0xFF, 0xFF, 0xFF}, true},
+        // The 9th sprite on the line is missed, its tile index is compared instead of its Y
+        std::tuple{Sprite{0xFF, 0xFF, 0xFF, 0xFF}, Sprite{100, 0xFF, 0xFF, 0xFF}, false},
+        // And a tile index on the line overflows it without a 9th sprite
+        std::tuple{Sprite{0xFF, 0xFF, 0xFF, 0xFF}, Sprite{0xFF, 100, 0xFF, 0xFF}, true}
+    );
+
+    const RomHeader header{
+        .prg_rom_size = 0x4000,
+        .prg_rom_banks = 1,
+        .chr_rom_size = 0x2000,
+        .chr_rom_banks = 1,
+        .prg_ram_size = 0,
+        .hardware_mirroring = Mirroring::Horizontal,
+        .mapper_number = 0,
+    };
+    InterruptLines interrupts{};
+    Ppu ppu{
+        std::make_shared<Nrom>(std::make_shared<const RomImage>(
+            header,
+            std::vector<byte>(0x4000),
+            std::vector<byte>(0x2000)
+        )),
+        &interrupts
+    };
+
+    std::array<Sprite, 64> oam{};
+    oam.fill({0xFF, 0xFF, 0xFF, 0xFF});
+    std::fill_n(oam.begin(), 8, Sprite{100, 0, 0, 0});
+    oam[8] = sprite_8;
+    oam[9] = sprite_9;
+    ppu.CpuWrite(0x2003, 0x00);
+    for (const auto& sprite : oam) {
+        for (const byte data : {sprite.y, sprite.tile_index, sprite.attribs, sprite.x}) {
+            ppu.CpuWrite(0x2004, data);
+        }
+    }
+    ppu.CpuWrite(0x2001, 0x18);
+
+    // The flag is set by the evaluation at the end of line 100, which the status events see coming
+    while (ppu.Scanline() != 101) {
+        const auto dots = ppu.DotsUntilNextStatusEvent(true);
+        const auto changes = ppu.StatusChanges();
+        const bool line_100_evaluated = ppu.Scanline() == 100 && ppu.LineCycles() >= NES_WIDTH;
+        REQUIRE((ppu.CpuRead(0x2002) & 0x20) == (overflows && line_100_evaluated ? 0x20 : 0x00));
+        ppu.Tick(0);
+        if (ppu.StatusChanges() != changes) {
+            REQUIRE(dots <= 1);
+        }
+    }
+    REQUIRE((ppu.CpuRead(0x2002) & 0x20) == (overflows ? 0x20 : 0x00));
+}
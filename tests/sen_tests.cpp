@@ -0,0 +1,231 @@
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "constants.hxx"
+#include "debugger.hxx"
+#include "ppu.hxx"
+#include "ppu_event_log.hxx"
+#include "rom_image.hxx"
+#include "sen.hxx"
+
+class NullAudioQueue final : public AudioQueue {
+  public:
+    void push(float) override {}
+};
+
+// NROM image with a single 16KB PRG bank at $C000 running `program`
+static RomArgs make_rom(const std::vector<byte>& program) {
+    std::vector<byte> rom{'N', 'E', 'S', 0x1A, 1, 1, 0, 0};
+    rom.resize(16, 0x00);
+
+    std::vector<byte> prg(0x4000, 0xEA); // NOP
+    std::ranges::copy(program, prg.begin());
+    prg[0x3FFC] = 0x00; // Reset vector, $C000
+    prg[0x3FFD] = 0xC0;
+    rom.insert(rom.end(), prg.begin(), prg.end());
+    rom.resize(rom.size() + 0x2000, 0x00); // CHR-ROM
+
+    return RomArgs{rom};
+}
+
+// Counts X up to 16 after writing to $0010, then jams
+static const std::vector<byte> PROGRAM{
+    0xA9, 0x42, // C000: LDA #$42
+    0x85, 0x10, // C002: STA $10
+    0xE8, // C004: INX
+    0xE0, 0x10, // C005: CPX #$10
+    0xD0, 0xFB, // C007: BNE $C004
+    0x02, // C009: JAM
+};
+
+TEST_CASE("RunUntil stops on the first condition met", "[sen][runUntil]") {
+    Sen sen{make_rom(PROGRAM), std::make_shared<NullAudioQueue>()};
+
+    // Through a mirror of $0010
+    REQUIRE(sen.RunUntil({.ram_write = 0x0810}) == StopReason::RamWrite);
+    REQUIRE(sen.RunUntil({.breakpoint = 0xC009}) == StopReason::Breakpoint);
+    REQUIRE(sen.RunUntil({.cycles = 100}) == StopReason::Jam);
+    REQUIRE(sen.RunUntil({.cycles = 100, .jam = false}) == StopReason::Cycles);
+}
+
+TEST_CASE("RunUntil stops at scanlines and frame ends", "[sen][runUntil]") {
+    // Loops forever
+    Sen sen{make_rom({0x4C, 0x00, 0xC0}), std::make_shared<NullAudioQueue>()};
+    sen.SetIdleLoopSkipping(true);
+
+    size_t frames = 0;
+    sen.SetFrameEndCallback([&frames](const PpuFramebuffer&) { frames++; });
+
+    REQUIRE(sen.RunUntil({.frame_end = true}) == StopReason::FrameEnd);
+    REQUIRE(frames == 1);
+    REQUIRE(sen.RunUntil({.scanline = 100}) == StopReason::Scanline);
+    REQUIRE(frames == 1);
+    REQUIRE(sen.RunUntil({.frame_end = true, .scanline = 100}) == StopReason::FrameEnd);
+    REQUIRE(frames == 2);
+
+    // Frames run without output are not handed out
+    sen.RunForOneFrame(false);
+    REQUIRE(frames == 2);
+    sen.RunForOneFrame();
+    REQUIRE(frames == 3);
+}
+
+TEST_CASE("RunUntil stops at scanlines stepped over by OAM DMA", "[sen][runUntil]") {
+    // STA $4014 over and over, each one stalls the CPU for more than 4 lines
+    const auto sen = std::make_shared<Sen>(
+        make_rom({0x8D, 0x14, 0x40, 0x4C, 0x00, 0xC0}),
+        std::make_shared<NullAudioQueue>()
+    );
+    const Debugger debugger{sen};
+    PpuState state{};
+
+    for (unsigned int scanline = 0; scanline < 262; scanline++) {
+        INFO("Scanline " << scanline);
+        const StopConditions conditions{.cycles = CYCLES_PER_FRAME, .scanline = scanline};
+        REQUIRE(sen->RunUntil(conditions) == StopReason::Scanline);
+        debugger.load_ppu_state(state);
+        REQUIRE((state.scanline + 262 - scanline) % 262 < 5);
+    }
+
+    REQUIRE(sen->RunUntil({.cycles = CYCLES_PER_FRAME, .frame_end = true}) == StopReason::FrameEnd);
+    debugger.load_ppu_state(state);
+    REQUIRE(state.scanline - 240 < 5);
+}
+
+// Runs `program` for a few frames with idle loop skipping on and off and checks that both end up
+// in the same state after every frame. Returns the cycles fast-forwarded in the last one
+static uint64_t compare_idle_loop_skipping(const std::vector<byte>& program) {
+    const auto rom = make_rom(program);
+    const auto plain = std::make_shared<Sen>(rom, std::make_shared<NullAudioQueue>());
+    const auto skipping = std::make_shared<Sen>(rom, std::make_shared<NullAudioQueue>());
+    skipping->SetIdleLoopSkipping(true);
+    const Debugger plain_debugger{plain};
+    const Debugger skipping_debugger{skipping};
+
+    std::array<byte, IWRAM_SIZE> plain_ram{};
+    std::array<byte, IWRAM_SIZE> skipping_ram{};
+    for (unsigned int frame = 0; frame < 4; frame++) {
+        plain->RunForOneFrame(false);
+        skipping->RunForOneFrame(false);
+
+        const auto plain_state = plain_debugger.GetCpuState();
+        const auto skipping_state = skipping_debugger.GetCpuState();
+        REQUIRE(plain_state.pc == skipping_state.pc);
+        REQUIRE(plain_state.a == skipping_state.a);
+        REQUIRE(plain_state.x == skipping_state.x);
+        REQUIRE(plain_state.y == skipping_state.y);
+        REQUIRE(plain_state.s == skipping_state.s);
+        REQUIRE(plain_state.p == skipping_state.p);
+        REQUIRE(plain_debugger.CpuCycles() == skipping_debugger.CpuCycles());
+
+        plain->ObserveRam(plain_ram);
+        skipping->ObserveRam(skipping_ram);
+        REQUIRE(plain_ram == skipping_ram);
+    }
+
+    return skipping->IdleCyclesFastForwardedLastFrame();
+}
+
+TEST_CASE("Loops polling RAM or PPUSTATUS are fast-forwarded", "[sen][idleLoop]") {
+    // LDA #$00, STA $10, then LDA $10, BEQ back to it
+    REQUIRE(compare_idle_loop_skipping({0xA9, 0x00, 0x85, 0x10, 0xA5, 0x10, 0xF0, 0xFC}) > 0);
+    // BIT $2002, BPL back to it until VBlank, JMP $C000
+    REQUIRE(compare_idle_loop_skipping({0x2C, 0x02, 0x20, 0x10, 0xFB, 0x4C, 0x00, 0xC0}) > 0);
+}
+
+TEST_CASE("Loops with side effects are never fast-forwarded", "[sen][idleLoop]") {
+    const auto program = GENERATE(
+        // Writes RAM: LDA #$00, STA $10, then LDA $10, STA $11, BEQ back to the LDA
+        std::vector<byte>{0xA9, 0x00, 0x85, 0x10, 0xA5, 0x10, 0x85, 0x11, 0xF0, 0xFA},
+        // Shifts the controller: LDA $4016, AND #$00, BEQ back to it
+        std::vector<byte>{0xAD, 0x16, 0x40, 0x29, 0x00, 0xF0, 0xF9},
+        // Increments the VRAM address: LDA $2007, AND #$00, BEQ back to it
+        std::vector<byte>{0xAD, 0x07, 0x20, 0x29, 0x00, 0xF0, 0xF9}
+    );
+
+    REQUIRE(compare_idle_loop_skipping(program) == 0);
+}
+
+TEST_CASE("The event log records PPU register accesses where they happen", "[sen][eventLog]") {
+    Sen sen{
+        make_rom({
+            0xA9, 0x1E, // C000: LDA #$1E
+            0x8D, 0x01, 0x20, // C002: STA $2001
+            0xAD, 0x02, 0x20, // C005: LDA $2002
+            0x4C, 0x08, 0xC0, // C008: JMP $C008
+        }),
+        std::make_shared<NullAudioQueue>()
+    };
+    REQUIRE(sen.EventLog() == nullptr);
+    sen.SetEventLogging(true);
+    REQUIRE(sen.EventLog() != nullptr);
+
+    // The program runs during the pre-render line that ends the first frame
+    sen.RunForOneFrame();
+    const auto events = sen.EventLog()->LastFrame();
+    REQUIRE(events.size() == 2);
+
+    const auto& write = events[0];
+    REQUIRE(write.type == PpuEventType::RegisterWrite);
+    REQUIRE(write.address == 0x2001);
+    REQUIRE(write.value == 0x1E);
+    REQUIRE(write.pc == 0xC002);
+    REQUIRE(write.frame == 0);
+    REQUIRE(write.scanline == 261); // Pre-render line
+
+    // Both accesses happen on the last cycle of their instructions, 4 CPU cycles apart
+    const auto& read = events[1];
+    REQUIRE(read.type == PpuEventType::RegisterRead);
+    REQUIRE(read.address == 0x2002);
+    REQUIRE(read.pc == 0xC005);
+    REQUIRE(read.scanline == 261);
+    REQUIRE(read.dot == write.dot + 12);
+
+    // Pausing keeps the log and the frame it has
+    const auto* log = sen.EventLog();
+    sen.SetEventLogPaused(true);
+    sen.RunForOneFrame();
+    REQUIRE(sen.EventLog() == log);
+    REQUIRE(log->LastFrame().size() == 2);
+    sen.SetEventLogPaused(false);
+    sen.RunForOneFrame();
+    REQUIRE(log->LastFrame().empty());
+
+    sen.SetEventLogging(false);
+    REQUIRE(sen.EventLog() == nullptr);
+}
+
+TEST_CASE("Instances of the same ROM share its image", "[sen][rom]") {
+    const auto rom = make_rom(PROGRAM);
+    const auto sink = std::make_shared<NullAudioQueue>();
+    Sen first{rom, sink};
+    Sen second{rom, sink};
+    REQUIRE(LoadRomImage(rom) == LoadRomImage(rom));
+
+    // PRG-ROM, CHR-ROM and its decoded tiles only count once
+    const auto footprint = first.Footprint();
+    REQUIRE(footprint.shared >= 0x4000 + 0x2000 + 0x2000 * 8);
+    REQUIRE(second.Footprint().shared == footprint.shared);
+    REQUIRE(second.Footprint().instance == footprint.instance);
+
+    // The framebuffer takes up most of what is left, each instance must stay well under the
+    // ROM images it would otherwise copy
+    REQUIRE(footprint.instance >= NES_WIDTH * NES_HEIGHT + IWRAM_SIZE);
+    REQUIRE(footprint.instance < 0x20000);
+
+    // Everything an instance allocates is counted, the event log too
+    first.SetEventLogging(true);
+    REQUIRE(
+        first.Footprint().instance
+        >= footprint.instance + 2 * PpuEventLog::CAPACITY * sizeof(PpuEvent)
+    );
+
+    // Different contents get an image of their own
+    const auto other = make_rom({0x02});
+    REQUIRE(LoadRomImage(other) != LoadRomImage(rom));
+}